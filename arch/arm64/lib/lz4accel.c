@@ -0,0 +1,291 @@
+/*
+ * NEON LZ4 decoder variant selection
+ *
+ * Two builds of the decoder exist, with and without software prefetch,
+ * and which one wins depends on the core it runs on.  Rather than keying
+ * the choice off a list of part numbers, time both on a synthetic stream
+ * once per core type (MIDR model) and remember the winner.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) "lz4accel: " fmt
+
+#include <linux/cpu.h>
+#include <linux/export.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/lz4accel.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#include <asm/cpu.h>
+
+/* Decoded size of the calibration stream */
+#define LZ4_ACCEL_SAMPLE_SIZE	(16 * 1024)
+/* Trailing literal run, so the accelerated prefix covers every match */
+#define LZ4_ACCEL_SAMPLE_TAIL	(2 * LZ4_ACCEL_MARGIN)
+#define LZ4_ACCEL_CALIB_LOOPS	4
+/* big.LITTLE systems have two or three core types */
+#define LZ4_ACCEL_MAX_PARTS	4
+
+struct lz4_accel_part {
+	u32			midr;
+	lz4_decompress_asm_t	fn;
+};
+
+static struct lz4_accel_part lz4_accel_parts[LZ4_ACCEL_MAX_PARTS];
+static unsigned int lz4_accel_nr_parts;
+static DEFINE_SPINLOCK(lz4_accel_lock);
+
+static uint8_t *lz4_accel_src, *lz4_accel_dst;
+static size_t lz4_accel_src_len, lz4_accel_dst_len;
+
+static int lz4_decompress_asm_select(uint8_t **dst_ptr, uint8_t *dst_begin,
+				     uint8_t *dst_end, const uint8_t **src_ptr,
+				     const uint8_t *src_end);
+
+lz4_decompress_asm_t lz4_decompress_asm_fn[NR_CPUS] __read_mostly = {
+	[0 ... NR_CPUS-1]  = lz4_decompress_asm_select,
+};
+EXPORT_SYMBOL(lz4_decompress_asm_fn);
+EXPORT_SYMBOL(_lz4_decompress_asm);
+EXPORT_SYMBOL(_lz4_decompress_asm_noprfm);
+
+/* Used until the calibration data for this core type is available */
+static lz4_decompress_asm_t lz4_accel_guess(void)
+{
+	switch (read_cpuid_part_number()) {
+	case ARM_CPU_PART_CORTEX_A53:
+		return _lz4_decompress_asm_noprfm;
+	}
+	return _lz4_decompress_asm;
+}
+
+static lz4_decompress_asm_t lz4_accel_lookup(u32 midr)
+{
+	unsigned int i, nr = smp_load_acquire(&lz4_accel_nr_parts);
+
+	for (i = 0; i < nr; i++)
+		if (lz4_accel_parts[i].midr == midr)
+			return lz4_accel_parts[i].fn;
+	return NULL;
+}
+
+static u64 lz4_accel_time(lz4_decompress_asm_t fn)
+{
+	u64 t, best = U64_MAX;
+	int i;
+
+	for (i = 0; i < LZ4_ACCEL_CALIB_LOOPS; i++) {
+		uint8_t *op = lz4_accel_dst;
+		const uint8_t *ip = lz4_accel_src;
+
+		t = local_clock();
+		if (fn(&op, lz4_accel_dst,
+		       lz4_accel_dst + lz4_accel_dst_len - LZ4_ACCEL_MARGIN,
+		       &ip, lz4_accel_src + lz4_accel_src_len - LZ4_ACCEL_MARGIN))
+			return U64_MAX;
+		best = min(best, local_clock() - t);
+	}
+	return best;
+}
+
+/*
+ * Time both variants on the calling cpu and record the faster one for
+ * its core type.  Must be called with NEON enabled.  Returns NULL if the
+ * stream isn't built yet or another cpu is calibrating right now.
+ */
+static lz4_decompress_asm_t lz4_accel_calibrate(u32 midr)
+{
+	lz4_decompress_asm_t fn;
+	unsigned int nr;
+	u64 prfm, noprfm;
+
+	if (!smp_load_acquire(&lz4_accel_src) || !spin_trylock(&lz4_accel_lock))
+		return NULL;
+
+	fn = lz4_accel_lookup(midr);
+	nr = lz4_accel_nr_parts;
+	if (fn)
+		goto out;
+	if (nr == LZ4_ACCEL_MAX_PARTS) {
+		fn = lz4_accel_guess();
+		goto out;
+	}
+
+	prfm = lz4_accel_time(_lz4_decompress_asm);
+	noprfm = lz4_accel_time(_lz4_decompress_asm_noprfm);
+	if (WARN_ON_ONCE(prfm == U64_MAX || noprfm == U64_MAX)) {
+		fn = lz4_accel_guess();
+		goto out;
+	}
+	fn = noprfm < prfm ? _lz4_decompress_asm_noprfm : _lz4_decompress_asm;
+
+	lz4_accel_parts[nr].midr = midr;
+	lz4_accel_parts[nr].fn = fn;
+	smp_store_release(&lz4_accel_nr_parts, nr + 1);
+
+	pr_info("part %03x: prfm %llu ns, noprfm %llu ns, using %s\n",
+		MIDR_PARTNUM(midr), prfm, noprfm,
+		fn == _lz4_decompress_asm ? "prfm" : "noprfm");
+out:
+	spin_unlock(&lz4_accel_lock);
+	return fn;
+}
+
+/*
+ * Return the variant to use on this cpu, calibrating its core type on
+ * first use.  Must be called with NEON enabled.
+ */
+lz4_decompress_asm_t lz4_decompress_asm_current(void)
+{
+	const unsigned int cpu = smp_processor_id();
+	const u32 midr = read_cpuid_id() & MIDR_CPU_MODEL_MASK;
+	lz4_decompress_asm_t fn = lz4_decompress_asm_fn[cpu];
+
+	if (fn != lz4_decompress_asm_select)
+		return fn;
+
+	fn = lz4_accel_lookup(midr);
+	if (!fn)
+		fn = lz4_accel_calibrate(midr);
+	if (!fn)
+		return lz4_accel_guess();	/* try again next time */
+
+	lz4_decompress_asm_fn[cpu] = fn;
+	return fn;
+}
+EXPORT_SYMBOL(lz4_decompress_asm_current);
+
+static int lz4_decompress_asm_select(uint8_t **dst_ptr, uint8_t *dst_begin,
+				     uint8_t *dst_end, const uint8_t **src_ptr,
+				     const uint8_t *src_end)
+{
+	return lz4_decompress_asm_current()(dst_ptr, dst_begin, dst_end,
+					    src_ptr, src_end);
+}
+
+const uint8_t *lz4_accel_sample(size_t *src_len, size_t *dst_len)
+{
+	const uint8_t *src = smp_load_acquire(&lz4_accel_src);
+
+	*src_len = lz4_accel_src_len;
+	*dst_len = lz4_accel_dst_len;
+	return src;
+}
+EXPORT_SYMBOL(lz4_accel_sample);
+
+static u32 __init lz4_accel_rand(u32 *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+static uint8_t * __init lz4_accel_put_len(uint8_t *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+static uint8_t * __init lz4_accel_put_literals(uint8_t *op, size_t len,
+					       size_t mlen, u32 *seed)
+{
+	*op++ = (min_t(size_t, len, 15) << 4) |
+		min_t(size_t, mlen ? mlen - 4 : 0, 15);
+	if (len >= 15)
+		op = lz4_accel_put_len(op, len - 15);
+	while (len--)
+		*op++ = 'a' + lz4_accel_rand(seed) % 26;
+	return op;
+}
+
+/*
+ * Hand-encode a stream mixing short and long literal runs with near
+ * (overlapping, under 32 bytes) and far matches, which is roughly what
+ * compressed filesystem data looks like to the decoder.  Returns the
+ * compressed length.
+ */
+static size_t __init lz4_accel_build_sample(uint8_t *out, size_t *dst_len)
+{
+	const size_t limit = LZ4_ACCEL_SAMPLE_SIZE - LZ4_ACCEL_SAMPLE_TAIL;
+	uint8_t *op = out;
+	size_t pos = 0;
+	u32 seed = 0x2545f491;
+
+	while (pos + 512 <= limit) {
+		u32 r = lz4_accel_rand(&seed);
+		size_t lit = 1 + (r & 15);
+		size_t mlen = 4 + ((r >> 4) & 31);
+		size_t off;
+
+		if (!(r & (7 << 9)))
+			lit += 32 + (lz4_accel_rand(&seed) & 63);
+		if (!(r & (7 << 12)))
+			mlen += 64 + (lz4_accel_rand(&seed) & 127);
+
+		r = lz4_accel_rand(&seed);
+		if (r & 1)
+			off = 1 + (r >> 1) % 31;
+		else
+			off = 32 + (r >> 1) % 4064;
+		off = min(off, pos + lit);
+
+		op = lz4_accel_put_literals(op, lit, mlen, &seed);
+		*op++ = off;
+		*op++ = off >> 8;
+		if (mlen - 4 >= 15)
+			op = lz4_accel_put_len(op, mlen - 4 - 15);
+		pos += lit + mlen;
+	}
+
+	/* the last sequence is literals only */
+	op = lz4_accel_put_literals(op, LZ4_ACCEL_SAMPLE_TAIL, 0, &seed);
+	*dst_len = pos + LZ4_ACCEL_SAMPLE_TAIL;
+	return op - out;
+}
+
+static long lz4_accel_calibrate_cpu(void *unused)
+{
+	kernel_neon_begin();
+	lz4_decompress_asm_current();
+	kernel_neon_end();
+	return 0;
+}
+
+static int __init lz4_accel_init(void)
+{
+	uint8_t *src, *dst;
+	unsigned int cpu;
+
+	/* no sequence encodes to more than its decoded size plus a byte */
+	src = kmalloc(2 * LZ4_ACCEL_SAMPLE_SIZE, GFP_KERNEL);
+	dst = kmalloc(LZ4_ACCEL_SAMPLE_SIZE, GFP_KERNEL);
+	if (!src || !dst) {
+		kfree(src);
+		kfree(dst);
+		return -ENOMEM;
+	}
+
+	lz4_accel_src_len = lz4_accel_build_sample(src, &lz4_accel_dst_len);
+	lz4_accel_dst = dst;
+	smp_store_release(&lz4_accel_src, src);
+
+	/* cpus brought up later calibrate on first use */
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		u32 midr = per_cpu(cpu_data, cpu).reg_midr;
+
+		if (!lz4_accel_lookup(midr & MIDR_CPU_MODEL_MASK))
+			work_on_cpu(cpu, lz4_accel_calibrate_cpu, NULL);
+	}
+	put_online_cpus();
+	return 0;
+}
+subsys_initcall(lz4_accel_init);
@@ -47,6 +47,7 @@
 #include <linux/freezer.h>
 #include <linux/fs.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
@@ -138,6 +139,10 @@ static int binder_set_stop_on_user_error(const char *val,
 module_param_call(stop_on_user_error, binder_set_stop_on_user_error,
 	param_get_int, &binder_stop_on_user_error, 0644);
 
+/* Processes opened while this is set collect latency histograms */
+static bool binder_latency_stats;
+module_param_named(latency_stats, binder_latency_stats, bool, 0644);
+
 #define binder_debug(mask, x...) \
 	do { \
 		if (binder_debug_mask & mask) \
@@ -2464,6 +2469,7 @@ struct binder_ptr_fixup {
  * @offset		offset in target buffer
  * @sender_uaddr	user address in source buffer
  * @length		bytes to copy
+ * @donate		whole pages may be moved from a donation ring
  * @node		list node
  *
  * This is used for the sg copy list (sgc) which is created and consumed
@@ -2476,9 +2482,53 @@ struct binder_sg_copy {
 	binder_size_t offset;
 	const void __user *sender_uaddr;
 	size_t length;
+	bool donate;
 	struct list_head node;
 };
 
+/**
+ * binder_sg_copy_chunk() - copy one fixup-free chunk of sg data
+ * @alloc:	binder_alloc associated with @buffer
+ * @buffer:	binder buffer in target process
+ * @offset:	offset in @buffer
+ * @sender_uaddr: user address in source process
+ * @size:	bytes to copy
+ * @donate:	try to move whole pages instead of copying them
+ *
+ * The chunk holds no fixups, so any page it fully covers can be taken
+ * from the sender's donation ring as is.
+ *
+ * Return: bytes that could not be copied
+ */
+static unsigned long binder_sg_copy_chunk(struct binder_alloc *alloc,
+					  struct binder_buffer *buffer,
+					  binder_size_t offset,
+					  const void __user *sender_uaddr,
+					  size_t size, bool donate)
+{
+	size_t done = 0;
+
+	if (donate) {
+		size_t head = PAGE_ALIGN((uintptr_t)sender_uaddr) -
+			      (uintptr_t)sender_uaddr;
+
+		if (size > head && size - head >= PAGE_SIZE) {
+			if (head && binder_alloc_copy_user_to_buffer(alloc,
+						buffer, offset,
+						sender_uaddr, head))
+				return size;
+			done = head + binder_alloc_donate_pages(alloc, buffer,
+						offset + head,
+						sender_uaddr + head,
+						(size - head) & PAGE_MASK);
+		}
+	}
+
+	return binder_alloc_copy_user_to_buffer(alloc, buffer, offset + done,
+						sender_uaddr + done,
+						size - done);
+}
+
 /**
  * binder_do_deferred_txn_copies() - copy and fixup scatter-gather data
  * @alloc:	binder_alloc associated with @buffer
@@ -2520,11 +2570,11 @@ static int binder_do_deferred_txn_copies(struct binder_alloc *alloc,
 			copy_size = pf ? min(bytes_left, (size_t)pf->offset - offset)
 				       : bytes_left;
 			if (!ret && copy_size)
-				ret = binder_alloc_copy_user_to_buffer(
+				ret = binder_sg_copy_chunk(
 						alloc, buffer,
 						offset,
 						sgc->sender_uaddr + bytes_copied,
-						copy_size);
+						copy_size, sgc->donate);
 			bytes_copied += copy_size;
 			if (copy_size != bytes_left) {
 				BUG_ON(!pf);
@@ -2596,6 +2646,7 @@ static void binder_cleanup_deferred_txn_lists(struct list_head *sgc_head,
  * @offset:		binder buffer offset in target process
  * @sender_uaddr:	user address in source process
  * @length:		bytes to copy
+ * @donate:		whole pages may be moved from a donation ring
  *
  * Specify a scatter-gather block to be copied. The actual copy must
  * be deferred until all the needed fixups are identified and queued.
@@ -2609,7 +2660,8 @@ static void binder_cleanup_deferred_txn_lists(struct list_head *sgc_head,
  * Return: 0=success, else -errno
  */
 static int binder_defer_copy(struct list_head *sgc_head, binder_size_t offset,
-			     const void __user *sender_uaddr, size_t length)
+			     const void __user *sender_uaddr, size_t length,
+			     bool donate)
 {
 	struct binder_sg_copy *bc = kzalloc(sizeof(*bc), GFP_KERNEL);
 
@@ -2619,6 +2671,7 @@ static int binder_defer_copy(struct list_head *sgc_head, binder_size_t offset,
 	bc->offset = offset;
 	bc->sender_uaddr = sender_uaddr;
 	bc->length = length;
+	bc->donate = donate;
 	INIT_LIST_HEAD(&bc->node);
 
 	/*
@@ -2850,6 +2903,53 @@ binder_find_outdated_transaction_ilocked(struct binder_transaction *t,
 	return NULL;
 }
 
+static void binder_latency_inc(struct binder_proc *proc,
+			       enum binder_latency_stage stage,
+			       unsigned int code, u64 ns)
+{
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+	unsigned int bucket = 0;
+
+	if (us)
+		bucket = min_t(unsigned int, ilog2(us) + 1,
+			       BINDER_LATENCY_BUCKETS - 1);
+	code = min_t(unsigned int, code, BINDER_LATENCY_CODES - 1);
+	this_cpu_inc(proc->latency_stats->hist[stage][code][bucket]);
+}
+
+/*
+ * Account a transaction handed to userspace by binder_thread_read().
+ * @wake_ns is when the reading thread stopped waiting; work queued
+ * while the thread was already running has no wakeup delay.
+ */
+static void binder_latency_account_read(struct binder_proc *proc,
+					struct binder_transaction *t,
+					u64 wake_ns)
+{
+	u64 now;
+
+	if (!t->enqueue_ns)
+		return;
+
+	now = ktime_get_ns();
+	wake_ns = max(wake_ns, t->enqueue_ns);
+	binder_latency_inc(proc, BINDER_LATENCY_ENQUEUE_TO_WAKEUP, t->code,
+			   wake_ns - t->enqueue_ns);
+	binder_latency_inc(proc, BINDER_LATENCY_WAKEUP_TO_READ, t->code,
+			   now - wake_ns);
+}
+
+/* Account the time from queueing @in_reply_to until @proc replied to it */
+static void binder_latency_account_reply(struct binder_proc *proc,
+					 struct binder_transaction *in_reply_to)
+{
+	if (!in_reply_to->enqueue_ns)
+		return;
+
+	binder_latency_inc(proc, BINDER_LATENCY_REPLY, in_reply_to->code,
+			   ktime_get_ns() - in_reply_to->enqueue_ns);
+}
+
 /**
  * binder_proc_transaction() - sends a transaction to a process and wakes it up
  * @t:		transaction to send
@@ -2901,6 +3001,9 @@ static int binder_proc_transaction(struct binder_transaction *t,
 		return proc->is_frozen ? BR_FROZEN_REPLY : BR_DEAD_REPLY;
 	}
 
+	if (proc->latency_stats)
+		t->enqueue_ns = ktime_get_ns();
+
 	if (!thread && !pending_async)
 		thread = binder_select_thread_ilocked(proc);
 
@@ -3595,6 +3698,7 @@ static void binder_transaction(struct binder_proc *proc,
 				to_binder_buffer_object(hdr);
 			size_t buf_left = sg_buf_end_offset - sg_buf_offset;
 			size_t num_valid;
+			bool donate = false;
 
 			if (bp->length > buf_left) {
 				binder_user_error("%d:%d got transaction with too large buffer\n",
@@ -3604,9 +3708,25 @@ static void binder_transaction(struct binder_proc *proc,
 				return_error_line = __LINE__;
 				goto err_bad_offset;
 			}
+			if (bp->flags & BINDER_BUFFER_FLAG_DONATE) {
+				/*
+				 * Pages can only be moved if the buffer keeps
+				 * its page offset in the target; pad up to it
+				 * when the sender left room for that.
+				 */
+				size_t pad = (bp->buffer -
+					      ((uintptr_t)t->buffer->user_data +
+					       sg_buf_offset)) & ~PAGE_MASK;
+
+				if (IS_ALIGNED(bp->buffer, sizeof(u64)) &&
+				    pad <= buf_left - bp->length) {
+					sg_buf_offset += pad;
+					donate = true;
+				}
+			}
 			ret = binder_defer_copy(&sgc_head, sg_buf_offset,
 				(const void __user *)(uintptr_t)bp->buffer,
-				bp->length);
+				bp->length, donate);
 			if (ret) {
 				return_error = BR_FAILED_REPLY;
 				return_error_param = ret;
@@ -3699,6 +3819,7 @@ static void binder_transaction(struct binder_proc *proc,
 		}
 		wake_up_interruptible_sync(&target_thread->wait);
 		binder_restore_priority(thread, &in_reply_to->saved_priority);
+		binder_latency_account_reply(proc, in_reply_to);
 		binder_free_transaction(in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
 		BUG_ON(t->buffer->async_transaction != 0);
@@ -4466,6 +4587,7 @@ static int binder_thread_read(struct binder_proc *proc,
 
 	int ret = 0;
 	int wait_for_proc_work;
+	u64 wake_ns = 0;
 
 	if (*consumed == 0) {
 		if (put_user(BR_NOOP, (uint32_t __user *)ptr))
@@ -4506,6 +4628,9 @@ static int binder_thread_read(struct binder_proc *proc,
 	if (ret)
 		return ret;
 
+	if (proc->latency_stats)
+		wake_ns = ktime_get_ns();
+
 	while (1) {
 		uint32_t cmd;
 		struct binder_transaction_data_secctx tr;
@@ -4806,6 +4931,8 @@ static int binder_thread_read(struct binder_proc *proc,
 
 		trace_binder_transaction_received(t);
 		binder_stat_br(proc, thread, cmd);
+		if (cmd != BR_REPLY)
+			binder_latency_account_read(proc, t, wake_ns);
 		binder_debug(BINDER_DEBUG_TRANSACTION,
 			     "%d:%d %s %d %d:%d, cmd %d size %zd-%zd ptr %016llx-%016llx\n",
 			     proc->pid, thread->pid,
@@ -4995,6 +5122,7 @@ static void binder_free_proc(struct binder_proc *proc)
 		kfree(device);
 	}
 	binder_alloc_deferred_release(&proc->alloc);
+	free_percpu(proc->latency_stats);
 	put_task_struct(proc->tsk);
 	put_cred(eproc->cred);
 	binder_stats_deleted(BINDER_STAT_PROC);
@@ -5661,6 +5789,9 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	if (proc->tsk != current->group_leader)
 		return -EINVAL;
 
+	if (vma->vm_pgoff == BINDER_DONATE_RING_OFFSET >> PAGE_SHIFT)
+		return binder_alloc_donate_mmap(&proc->alloc, vma);
+
 	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
 		     "%s: %d %lx-%lx (%ld K) vma %lx pagep %lx\n",
 		     __func__, proc->pid, vma->vm_start, vma->vm_end,
@@ -5724,6 +5855,8 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	refcount_inc(&binder_dev->ref);
 	proc->context = &binder_dev->context;
 	binder_alloc_init(&proc->alloc);
+	if (binder_latency_stats)
+		proc->latency_stats = alloc_percpu(struct binder_latency_stats);
 
 	binder_stats_created(BINDER_STAT_PROC);
 	proc->pid = current->group_leader->pid;
@@ -6554,6 +6687,81 @@ int binder_transaction_log_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static const char * const binder_latency_stage_strings[] = {
+	"enqueue_to_wakeup",
+	"wakeup_to_read",
+	"reply",
+};
+
+static void print_binder_proc_latency(struct seq_file *m,
+				      struct binder_proc *proc)
+{
+	u64 sum[BINDER_LATENCY_BUCKETS];
+	bool header = false;
+	int stage, code, bucket, cpu;
+
+	BUILD_BUG_ON(ARRAY_SIZE(binder_latency_stage_strings) !=
+		     BINDER_LATENCY_STAGE_COUNT);
+
+	for (stage = 0; stage < BINDER_LATENCY_STAGE_COUNT; stage++) {
+		for (code = 0; code < BINDER_LATENCY_CODES; code++) {
+			bool used = false;
+
+			memset(sum, 0, sizeof(sum));
+			for_each_possible_cpu(cpu) {
+				struct binder_latency_stats *stats =
+					per_cpu_ptr(proc->latency_stats, cpu);
+
+				for (bucket = 0; bucket < BINDER_LATENCY_BUCKETS;
+				     bucket++) {
+					sum[bucket] +=
+						stats->hist[stage][code][bucket];
+					used |= !!sum[bucket];
+				}
+			}
+			if (!used)
+				continue;
+
+			if (!header) {
+				seq_printf(m, "proc %d\n", proc->pid);
+				seq_printf(m, "context %s\n",
+					   proc->context->name);
+				header = true;
+			}
+			seq_printf(m, "  %s code ",
+				   binder_latency_stage_strings[stage]);
+			if (code == BINDER_LATENCY_CODES - 1)
+				seq_puts(m, "other:");
+			else
+				seq_printf(m, "%d:", code);
+			for (bucket = 0; bucket < BINDER_LATENCY_BUCKETS;
+			     bucket++)
+				seq_printf(m, " %llu", sum[bucket]);
+			seq_puts(m, "\n");
+		}
+	}
+}
+
+int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *proc;
+	int bucket;
+
+	seq_puts(m, "binder latency:\nbuckets (us): <1");
+	for (bucket = 1; bucket < BINDER_LATENCY_BUCKETS - 1; bucket++)
+		seq_printf(m, " <%d", 1 << bucket);
+	seq_printf(m, " >=%d\n", 1 << (BINDER_LATENCY_BUCKETS - 2));
+
+	mutex_lock(&binder_procs_lock);
+	hlist_for_each_entry(proc, &binder_procs, proc_node) {
+		if (proc->latency_stats)
+			print_binder_proc_latency(m, proc);
+	}
+	mutex_unlock(&binder_procs_lock);
+
+	return 0;
+}
+
 const struct file_operations binder_fops = {
 	.owner = THIS_MODULE,
 	.poll = binder_poll,
@@ -6630,6 +6838,11 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    NULL,
 				    &binder_transactions_fops);
+		debugfs_create_file("latency",
+				    0444,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_latency_fops);
 		debugfs_create_file("transaction_log",
 				    0444,
 				    binder_debugfs_dir_entry_root,
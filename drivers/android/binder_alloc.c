@@ -18,6 +18,7 @@
 #include <linux/slab.h>
 #include <linux/sched.h>
 #include <linux/list_lru.h>
+#include <linux/log2.h>
 #include <linux/ratelimit.h>
 #include <asm/cacheflush.h>
 #include <linux/uaccess.h>
@@ -382,6 +383,115 @@ static bool debug_low_async_space_locked(struct binder_alloc *alloc, int pid)
 	return false;
 }
 
+static int binder_alloc_size_class(size_t size)
+{
+	if (size > BINDER_ALLOC_CLASS_MAX_SIZE)
+		return -1;
+
+	size = max_t(size_t, size, 1 << BINDER_ALLOC_CLASS_MIN_SHIFT);
+	return order_base_2(size) - BINDER_ALLOC_CLASS_MIN_SHIFT;
+}
+
+/*
+ * Pick a cached buffer of at least @size bytes. Buffers on a class list
+ * may be smaller than the request, so the matching class is scanned
+ * first; anything on the next class is always large enough.
+ */
+static struct binder_buffer *binder_alloc_get_cached_buf_locked(
+				struct binder_alloc *alloc, size_t size)
+{
+	struct binder_buffer *buffer;
+	size_t buffer_size;
+	int class = binder_alloc_size_class(size);
+
+	if (class < 0)
+		return NULL;
+
+	list_for_each_entry(buffer, &alloc->size_class_buffers[class],
+			    class_entry) {
+		if (binder_alloc_buffer_size(alloc, buffer) >= size)
+			goto found;
+	}
+
+	if (++class == BINDER_ALLOC_NR_SIZE_CLASSES ||
+	    list_empty(&alloc->size_class_buffers[class]))
+		return NULL;
+	buffer = list_first_entry(&alloc->size_class_buffers[class],
+				  struct binder_buffer, class_entry);
+found:
+	buffer_size = binder_alloc_buffer_size(alloc, buffer);
+	list_del_init(&buffer->class_entry);
+	alloc->size_class_count[class]--;
+	alloc->size_class_bytes -= buffer_size;
+
+	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "%d: binder_alloc_buf size %zd got cached buffer %pK size %zd\n",
+		      alloc->pid, size, buffer, buffer_size);
+	return buffer;
+}
+
+/*
+ * Park a freed small sync buffer on its size class list. The buffer
+ * stays off both rb trees and keeps its pages, so neighbours treat it
+ * as allocated and the next allocation of the class needs no page
+ * range update.
+ */
+static bool binder_alloc_cache_buf_locked(struct binder_alloc *alloc,
+					  struct binder_buffer *buffer)
+{
+	size_t buffer_size;
+	int class;
+
+	if (buffer->async_transaction)
+		return false;
+
+	buffer_size = binder_alloc_buffer_size(alloc, buffer);
+	class = binder_alloc_size_class(buffer_size);
+	if (class < 0 ||
+	    alloc->size_class_count[class] >= BINDER_ALLOC_CLASS_DEPTH ||
+	    alloc->size_class_bytes + buffer_size > alloc->buffer_size / 8)
+		return false;
+
+	BUG_ON(buffer->free);
+	BUG_ON(buffer->transaction != NULL);
+
+	rb_erase(&buffer->rb_node, &alloc->allocated_buffers);
+	list_add(&buffer->class_entry, &alloc->size_class_buffers[class]);
+	alloc->size_class_count[class]++;
+	alloc->size_class_bytes += buffer_size;
+
+	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "%d: binder_free_buf %pK cached in class %d\n",
+		      alloc->pid, buffer, class);
+	return true;
+}
+
+static void binder_free_buf_locked(struct binder_alloc *alloc,
+				   struct binder_buffer *buffer);
+
+/* Return all cached buffers to the free tree, releasing their pages */
+static bool binder_alloc_flush_cached_locked(struct binder_alloc *alloc)
+{
+	struct binder_buffer *buffer, *tmp;
+	bool flushed = false;
+	int i;
+
+	for (i = 0; i < BINDER_ALLOC_NR_SIZE_CLASSES; i++) {
+		list_for_each_entry_safe(buffer, tmp,
+					 &alloc->size_class_buffers[i],
+					 class_entry) {
+			list_del_init(&buffer->class_entry);
+			binder_insert_allocated_buffer_locked(alloc, buffer);
+			binder_free_buf_locked(alloc, buffer);
+			flushed = true;
+		}
+		alloc->size_class_count[i] = 0;
+	}
+	alloc->size_class_bytes = 0;
+
+	return flushed;
+}
+
 static struct binder_buffer *binder_alloc_new_buf_locked(
 				struct binder_alloc *alloc,
 				size_t data_size,
@@ -390,7 +500,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 				int is_async,
 				int pid)
 {
-	struct rb_node *n = alloc->free_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
 	struct rb_node *best_fit = NULL;
@@ -433,6 +543,14 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	/* Pad 0-size buffers so they get assigned unique addresses */
 	size = max(size, sizeof(void *));
 
+	if (!is_async) {
+		buffer = binder_alloc_get_cached_buf_locked(alloc, size);
+		if (buffer)
+			goto init_buffer;
+	}
+
+retry:
+	n = alloc->free_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
@@ -456,6 +574,10 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 		size_t largest_free_size = 0;
 		size_t total_free_size = 0;
 
+		/* Give cached small buffers back before failing */
+		if (binder_alloc_flush_cached_locked(alloc))
+			goto retry;
+
 		for (n = rb_first(&alloc->allocated_buffers); n != NULL;
 		     n = rb_next(n)) {
 			buffer = rb_entry(n, struct binder_buffer, rb_node);
@@ -522,6 +644,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 
 	rb_erase(best_fit, &alloc->free_buffers);
 	buffer->free = 0;
+init_buffer:
 	buffer->allow_user_free = 0;
 	binder_insert_allocated_buffer_locked(alloc, buffer);
 	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
@@ -730,7 +853,22 @@ void binder_alloc_free_buf(struct binder_alloc *alloc,
 		buffer->clear_on_free = false;
 	}
 	mutex_lock(&alloc->mutex);
-	binder_free_buf_locked(alloc, buffer);
+	if (!binder_alloc_cache_buf_locked(alloc, buffer))
+		binder_free_buf_locked(alloc, buffer);
+	mutex_unlock(&alloc->mutex);
+}
+
+/**
+ * binder_alloc_flush_cached_bufs() - release cached small buffers
+ * @alloc:	binder_alloc for this proc
+ *
+ * Return the buffers held on the size class lists to the free tree so
+ * their pages go back on the binder LRU.
+ */
+void binder_alloc_flush_cached_bufs(struct binder_alloc *alloc)
+{
+	mutex_lock(&alloc->mutex);
+	binder_alloc_flush_cached_locked(alloc);
 	mutex_unlock(&alloc->mutex);
 }
 
@@ -819,6 +957,8 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 	mutex_lock(&alloc->mutex);
 	BUG_ON(alloc->vma);
 
+	binder_alloc_flush_cached_locked(alloc);
+
 	while ((n = rb_first(&alloc->allocated_buffers))) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 
@@ -1078,9 +1218,13 @@ static struct shrinker binder_shrinker = {
  */
 void binder_alloc_init(struct binder_alloc *alloc)
 {
+	int i;
+
 	alloc->pid = current->group_leader->pid;
 	mutex_init(&alloc->mutex);
 	INIT_LIST_HEAD(&alloc->buffers);
+	for (i = 0; i < BINDER_ALLOC_NR_SIZE_CLASSES; i++)
+		INIT_LIST_HEAD(&alloc->size_class_buffers[i]);
 }
 
 int binder_alloc_shrinker_init(void)
@@ -1236,6 +1380,267 @@ binder_alloc_copy_user_to_buffer(struct binder_alloc *alloc,
 	return 0;
 }
 
+/*
+ * Pages of a donation ring are owned by binder, not by the anon rmap, so
+ * once the sender's mapping is gone they can be inserted into another
+ * binder VMA with vm_insert_page() exactly like freshly allocated pages.
+ */
+#define BINDER_DONATE_BATCH	16
+
+/**
+ * struct binder_donate_ring - sender side pages for zero-copy sg buffers
+ * @refcount:	number of VMAs sharing the ring (split or moved mappings)
+ * @lock:	serializes concurrent faults populating @pages
+ * @pgoff:	vm_pgoff of the original mapping
+ * @nr_pages:	size of @pages
+ * @pages:	ring pages, NULL until faulted in or after being donated
+ *
+ * Donation takes the owner's mmap_sem for write, which excludes faults
+ * and unmapping, while it clears entries of @pages.
+ */
+struct binder_donate_ring {
+	atomic_t refcount;
+	spinlock_t lock;
+	pgoff_t pgoff;
+	size_t nr_pages;
+	struct page *pages[];
+};
+
+static void binder_donate_vm_open(struct vm_area_struct *vma)
+{
+	struct binder_donate_ring *ring = vma->vm_private_data;
+
+	atomic_inc(&ring->refcount);
+}
+
+static void binder_donate_vm_close(struct vm_area_struct *vma)
+{
+	struct binder_donate_ring *ring = vma->vm_private_data;
+	size_t i;
+
+	if (!atomic_dec_and_test(&ring->refcount))
+		return;
+
+	for (i = 0; i < ring->nr_pages; i++) {
+		if (ring->pages[i])
+			put_page(ring->pages[i]);
+	}
+	kfree(ring);
+}
+
+static int binder_donate_vm_fault(struct vm_area_struct *vma,
+				  struct vm_fault *vmf)
+{
+	struct binder_donate_ring *ring = vma->vm_private_data;
+	pgoff_t index = vmf->pgoff - ring->pgoff;
+	struct page *page, *new_page;
+
+	if (index >= ring->nr_pages)
+		return VM_FAULT_SIGBUS;
+
+	page = READ_ONCE(ring->pages[index]);
+	if (!page) {
+		new_page = alloc_page(GFP_HIGHUSER | __GFP_ZERO);
+		if (!new_page)
+			return VM_FAULT_OOM;
+
+		spin_lock(&ring->lock);
+		page = ring->pages[index];
+		if (!page)
+			page = ring->pages[index] = new_page;
+		spin_unlock(&ring->lock);
+		if (page != new_page)
+			__free_page(new_page);
+	}
+
+	get_page(page);
+	vmf->page = page;
+	return 0;
+}
+
+static const struct vm_operations_struct binder_donate_vm_ops = {
+	.open = binder_donate_vm_open,
+	.close = binder_donate_vm_close,
+	.fault = binder_donate_vm_fault,
+};
+
+/**
+ * binder_alloc_donate_mmap() - set up a page donation ring
+ * @alloc:	binder_alloc of the sending proc
+ * @vma:	shared mapping of the binder fd at BINDER_DONATE_RING_OFFSET
+ *
+ * Return: 0 on success, -errno otherwise
+ */
+int binder_alloc_donate_mmap(struct binder_alloc *alloc,
+			     struct vm_area_struct *vma)
+{
+	size_t nr_pages = (vma->vm_end - vma->vm_start) >> PAGE_SHIFT;
+	struct binder_donate_ring *ring;
+
+	if (!(vma->vm_flags & VM_SHARED) ||
+	    vma->vm_end - vma->vm_start > SZ_4M) {
+		binder_alloc_debug(BINDER_DEBUG_USER_ERROR,
+				   "%d: bad donation ring %lx-%lx flags %lx\n",
+				   alloc->pid, vma->vm_start, vma->vm_end,
+				   vma->vm_flags);
+		return -EINVAL;
+	}
+
+	ring = kzalloc(sizeof(*ring) + nr_pages * sizeof(ring->pages[0]),
+		       GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	atomic_set(&ring->refcount, 1);
+	spin_lock_init(&ring->lock);
+	ring->pgoff = vma->vm_pgoff;
+	ring->nr_pages = nr_pages;
+
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_ops = &binder_donate_vm_ops;
+	vma->vm_private_data = ring;
+	return 0;
+}
+
+/*
+ * Unmap up to @nr ring pages at @uaddr from the current (sending) task
+ * and take them over. Stops at the first page that isn't populated or is
+ * still referenced elsewhere, e.g. pinned for I/O.
+ */
+static size_t binder_donate_steal_pages(unsigned long uaddr,
+					struct page **pages, size_t nr)
+{
+	struct mm_struct *mm = current->mm;
+	struct binder_donate_ring *ring;
+	struct vm_area_struct *vma;
+	pgoff_t index;
+	size_t i = 0;
+
+	down_write(&mm->mmap_sem);
+	vma = find_vma(mm, uaddr);
+	if (!vma || vma->vm_ops != &binder_donate_vm_ops ||
+	    uaddr < vma->vm_start || uaddr + nr * PAGE_SIZE > vma->vm_end)
+		goto out;
+
+	ring = vma->vm_private_data;
+	index = vma->vm_pgoff + ((uaddr - vma->vm_start) >> PAGE_SHIFT) -
+		ring->pgoff;
+	zap_page_range(vma, uaddr, nr * PAGE_SIZE, NULL);
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = ring->pages[index + i];
+
+		if (!page || page_count(page) != 1)
+			break;
+		ring->pages[index + i] = NULL;
+		pages[i] = page;
+	}
+out:
+	up_write(&mm->mmap_sem);
+	return i;
+}
+
+/*
+ * Swap donated pages into @buffer. A page that can't be mapped into the
+ * target is copied into the page it was meant to replace instead.
+ */
+static void binder_donate_place_pages(struct binder_alloc *alloc,
+				      struct binder_buffer *buffer,
+				      binder_size_t buffer_offset,
+				      struct page **pages, size_t nr)
+{
+	struct vm_area_struct *vma = NULL;
+	struct mm_struct *mm = NULL;
+	size_t index, i;
+
+	index = (buffer->user_data + buffer_offset - alloc->buffer) >>
+		PAGE_SHIFT;
+
+	mutex_lock(&alloc->mutex);
+	if (mmget_not_zero(alloc->vma_vm_mm)) {
+		mm = alloc->vma_vm_mm;
+		down_write(&mm->mmap_sem);
+		vma = alloc->vma;
+	}
+
+	for (i = 0; i < nr; i++, index++) {
+		struct page *old_page = alloc->pages[index].page_ptr;
+		unsigned long user_page_addr = (uintptr_t)alloc->buffer +
+					       index * PAGE_SIZE;
+
+		if (vma) {
+			zap_page_range(vma, user_page_addr, PAGE_SIZE, NULL);
+			if (!vm_insert_page(vma, user_page_addr, pages[i])) {
+				alloc->pages[index].page_ptr = pages[i];
+				__free_page(old_page);
+				continue;
+			}
+			if (vm_insert_page(vma, user_page_addr, old_page))
+				pr_err("%d: failed to remap page at %lx\n",
+				       alloc->pid, user_page_addr);
+		}
+		copy_highpage(old_page, pages[i]);
+		put_page(pages[i]);
+	}
+
+	if (mm) {
+		up_write(&mm->mmap_sem);
+		mmput(mm);
+	}
+	mutex_unlock(&alloc->mutex);
+}
+
+/**
+ * binder_alloc_donate_pages() - move sender ring pages into a buffer
+ * @alloc: binder_alloc for this proc
+ * @buffer: binder buffer to be filled
+ * @buffer_offset: page aligned (in user space) offset into @buffer
+ * @from: page aligned address in the sender's donation ring
+ * @bytes: bytes to move, a multiple of PAGE_SIZE
+ *
+ * Instead of copying, take the pages backing @from away from the
+ * sender and install them in @buffer. Must be called from the sending
+ * task while @buffer is still being set up.
+ *
+ * Return: bytes moved from the start of the range; the caller copies
+ * the rest
+ */
+size_t binder_alloc_donate_pages(struct binder_alloc *alloc,
+				 struct binder_buffer *buffer,
+				 binder_size_t buffer_offset,
+				 const void __user *from,
+				 size_t bytes)
+{
+	struct page *pages[BINDER_DONATE_BATCH];
+	size_t done = 0;
+
+	if (!check_buffer(alloc, buffer, buffer_offset, bytes) ||
+	    !PAGE_ALIGNED(buffer->user_data + buffer_offset) ||
+	    !PAGE_ALIGNED(from) || !PAGE_ALIGNED(bytes))
+		return 0;
+
+	while (done < bytes) {
+		size_t nr = min_t(size_t, (bytes - done) >> PAGE_SHIFT,
+				  BINDER_DONATE_BATCH);
+		size_t got;
+
+		got = binder_donate_steal_pages((uintptr_t)from + done,
+						pages, nr);
+		if (got)
+			binder_donate_place_pages(alloc, buffer,
+						  buffer_offset + done,
+						  pages, got);
+		done += got << PAGE_SHIFT;
+		if (got < nr)
+			break;
+	}
+
+	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+			   "%d: donated %zd of %zd bytes to buffer %pK\n",
+			   alloc->pid, done, bytes, buffer);
+	return done;
+}
+
 static int binder_alloc_do_buffer_copy(struct binder_alloc *alloc,
 				       bool to_buffer,
 				       struct binder_buffer *buffer,
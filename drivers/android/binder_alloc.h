@@ -22,6 +22,7 @@ struct binder_transaction;
  * struct binder_buffer - buffer used for binder transactions
  * @entry:              entry alloc->buffers
  * @rb_node:            node for allocated_buffers/free_buffers rb trees
+ * @class_entry:        entry in alloc->size_class_buffers while cached
  * @free:               %true if buffer is free
  * @clear_on_free:      %true if buffer must be zeroed after use
  * @allow_user_free:    %true if user is allowed to free buffer
@@ -43,6 +44,7 @@ struct binder_buffer {
 	struct list_head entry; /* free and allocated entries by address */
 	struct rb_node rb_node; /* free entry by size or allocated entry */
 				/* by address */
+	struct list_head class_entry; /* cached small entry by size class */
 	unsigned free:1;
 	unsigned clear_on_free:1;
 	unsigned allow_user_free:1;
@@ -60,6 +62,17 @@ struct binder_buffer {
 	int    pid;
 };
 
+/*
+ * Small synchronous buffers are recycled through per-size-class lists
+ * instead of going back to the free_buffers tree. Classes are powers of
+ * two from 256 bytes up to BINDER_ALLOC_CLASS_MAX_SIZE.
+ */
+#define BINDER_ALLOC_CLASS_MIN_SHIFT	8
+#define BINDER_ALLOC_NR_SIZE_CLASSES	5
+#define BINDER_ALLOC_CLASS_MAX_SIZE	\
+	(1 << (BINDER_ALLOC_CLASS_MIN_SHIFT + BINDER_ALLOC_NR_SIZE_CLASSES - 1))
+#define BINDER_ALLOC_CLASS_DEPTH	8
+
 /**
  * struct binder_lru_page - page object used for binder shrinker
  * @page_ptr: pointer to physical page in mmap'd space
@@ -92,6 +105,10 @@ struct binder_lru_page {
  * @pages_high:         high watermark of offset in @pages
  * @oneway_spam_detected: %true if oneway spam detection fired, clear that
  * flag once the async buffer has returned to a healthy state
+ * @size_class_buffers: per size class lists of freed small sync buffers
+ *                      that keep their pages populated for reuse
+ * @size_class_count:   number of buffers on each @size_class_buffers list
+ * @size_class_bytes:   VA space held by all @size_class_buffers lists
  *
  * Bookkeeping structure for per-proc address space management for binder
  * buffers. It is normally initialized during binder_init() and binder_mmap()
@@ -113,6 +130,9 @@ struct binder_alloc {
 	int pid;
 	size_t pages_high;
 	bool oneway_spam_detected;
+	struct list_head size_class_buffers[BINDER_ALLOC_NR_SIZE_CLASSES];
+	unsigned int size_class_count[BINDER_ALLOC_NR_SIZE_CLASSES];
+	size_t size_class_bytes;
 };
 
 #ifdef CONFIG_ANDROID_BINDER_IPC_SELFTEST
@@ -137,6 +157,7 @@ binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 			     uintptr_t user_ptr);
 extern void binder_alloc_free_buf(struct binder_alloc *alloc,
 				  struct binder_buffer *buffer);
+extern void binder_alloc_flush_cached_bufs(struct binder_alloc *alloc);
 extern int binder_alloc_mmap_handler(struct binder_alloc *alloc,
 				     struct vm_area_struct *vma);
 extern void binder_alloc_deferred_release(struct binder_alloc *alloc);
@@ -170,6 +191,15 @@ binder_alloc_copy_user_to_buffer(struct binder_alloc *alloc,
 				 const void __user *from,
 				 size_t bytes);
 
+size_t binder_alloc_donate_pages(struct binder_alloc *alloc,
+				 struct binder_buffer *buffer,
+				 binder_size_t buffer_offset,
+				 const void __user *from,
+				 size_t bytes);
+
+int binder_alloc_donate_mmap(struct binder_alloc *alloc,
+			     struct vm_area_struct *vma);
+
 int binder_alloc_copy_to_buffer(struct binder_alloc *alloc,
 				struct binder_buffer *buffer,
 				binder_size_t buffer_offset,
@@ -137,6 +137,8 @@ static void binder_selftest_free_buf(struct binder_alloc *alloc,
 
 	for (i = 0; i < BUFFER_NUM; i++)
 		binder_alloc_free_buf(alloc, buffers[seq[i]]);
+	/* Small buffers are cached by size class; put them back first. */
+	binder_alloc_flush_cached_bufs(alloc);
 
 	for (i = 0; i < end / PAGE_SIZE; i++) {
 		/**
@@ -126,6 +126,9 @@ DEFINE_SHOW_ATTRIBUTE(binder_transactions);
 int binder_transaction_log_show(struct seq_file *m, void *unused);
 DEFINE_SHOW_ATTRIBUTE(binder_transaction_log);
 
+int binder_latency_show(struct seq_file *m, void *unused);
+DEFINE_SHOW_ATTRIBUTE(binder_latency);
+
 struct binder_transaction_log_entry {
 	int debug_id;
 	int debug_id_done;
@@ -380,6 +383,26 @@ enum binder_prio_state {
 	BINDER_PRIO_ABORT,	/* abort the pending priority restore */
 };
 
+/*
+ * Per-process transaction latency histograms. Bucket 0 counts latencies
+ * below 1us, bucket n counts [2^(n-1), 2^n) us and the last bucket is
+ * open ended. Codes from BINDER_LATENCY_CODES - 1 upwards share one row.
+ */
+enum binder_latency_stage {
+	BINDER_LATENCY_ENQUEUE_TO_WAKEUP,
+	BINDER_LATENCY_WAKEUP_TO_READ,
+	BINDER_LATENCY_REPLY,
+	BINDER_LATENCY_STAGE_COUNT,
+};
+
+#define BINDER_LATENCY_CODES	16
+#define BINDER_LATENCY_BUCKETS	16
+
+struct binder_latency_stats {
+	u32 hist[BINDER_LATENCY_STAGE_COUNT][BINDER_LATENCY_CODES]
+		[BINDER_LATENCY_BUCKETS];
+};
+
 /**
  * struct binder_proc - binder process bookkeeping
  * @proc_node:            element for binder_procs list
@@ -448,6 +471,9 @@ enum binder_prio_state {
  * @binderfs_entry:       process-specific binderfs log file
  * @oneway_spam_detection_enabled: process enabled oneway spam detection
  *                        or not
+ * @latency_stats:        per-cpu latency histograms of transactions
+ *                        received, NULL unless enabled at open time
+ *                        (per-cpu counters, no lock needed)
  *
  * Bookkeeping structure for binder processes
  */
@@ -484,6 +510,7 @@ struct binder_proc {
 	spinlock_t outer_lock;
 	struct dentry *binderfs_entry;
 	bool oneway_spam_detection_enabled;
+	struct binder_latency_stats __percpu *latency_stats;
 };
 
 /**
@@ -612,6 +639,7 @@ struct binder_transaction {
 	kuid_t	sender_euid;
 	struct list_head fd_fixups;
 	binder_uintptr_t security_ctx;
+	u64	enqueue_ns;	/* for @to_proc latency stats, 0 if off */
 	/**
 	 * @lock:  protects @from, @to_proc, and @to_thread
 	 *
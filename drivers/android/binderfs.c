@@ -657,6 +657,13 @@ static int init_binder_logs(struct super_block *sb)
 		goto out;
 	}
 
+	dentry = binderfs_create_file(binder_logs_root_dir, "latency",
+				      &binder_latency_fops, NULL);
+	if (IS_ERR(dentry)) {
+		ret = PTR_ERR(dentry);
+		goto out;
+	}
+
 	dentry = binderfs_create_file(binder_logs_root_dir,
 				      "transaction_log",
 				      &binder_transaction_log_fops,
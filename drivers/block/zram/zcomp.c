@@ -15,6 +15,7 @@
 #include <linux/sched.h>
 #include <linux/cpu.h>
 #include <linux/crypto.h>
+#include <linux/highmem.h>
 
 #include "zcomp.h"
 
@@ -153,6 +154,41 @@ int zcomp_compress(struct zcomp_strm *zstrm,
 			zstrm->buffer, dst_len);
 }
 
+/*
+ * Compress a vector of pages back to back on a single per-cpu stream,
+ * handing every result to @store before the stream buffer is reused.
+ * NULL entries in @pages are skipped. Returns 0, or the first error from
+ * the backend or from @store, in which case the remaining pages are left
+ * untouched.
+ */
+int zcomp_compress_batch(struct zcomp *comp, struct page **pages,
+		unsigned int nr_pages, zcomp_store_fn store, void *private)
+{
+	struct zcomp_strm *zstrm;
+	unsigned int i, dst_len;
+	void *src;
+	int ret = 0;
+
+	zstrm = zcomp_stream_get(comp);
+	for (i = 0; i < nr_pages; i++) {
+		if (!pages[i])
+			continue;
+
+		src = kmap_atomic(pages[i]);
+		ret = zcomp_compress(zstrm, src, &dst_len);
+		kunmap_atomic(src);
+		if (ret)
+			break;
+
+		ret = store(private, i, zstrm->buffer, dst_len);
+		if (ret)
+			break;
+	}
+	zcomp_stream_put(comp);
+
+	return ret;
+}
+
 int zcomp_decompress(struct zcomp_strm *zstrm,
 		const void *src, unsigned int src_len, void *dst)
 {
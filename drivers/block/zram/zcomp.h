@@ -16,6 +16,13 @@ struct zcomp_strm {
 	struct crypto_comp *tfm;
 };
 
+/*
+ * Consumer of a batched compression result. @dst is the stream buffer and
+ * is only valid until the callback returns.
+ */
+typedef int (*zcomp_store_fn)(void *private, unsigned int idx,
+		const void *dst, unsigned int dst_len);
+
 /* dynamic per-device compression frontend */
 struct zcomp {
 	struct zcomp_strm * __percpu *stream;
@@ -36,6 +43,9 @@ void zcomp_stream_put(struct zcomp *comp);
 int zcomp_compress(struct zcomp_strm *zstrm,
 		const void *src, unsigned int *dst_len);
 
+int zcomp_compress_batch(struct zcomp *comp, struct page **pages,
+		unsigned int nr_pages, zcomp_store_fn store, void *private);
+
 int zcomp_decompress(struct zcomp_strm *zstrm,
 		const void *src, unsigned int src_len, void *dst);
 
@@ -32,14 +32,19 @@
 #include <linux/idr.h>
 #include <linux/sysfs.h>
 #include <linux/debugfs.h>
+#include <linux/cpumask.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
+#include "zram_dedup.h"
 
 static DEFINE_IDR(zram_index_idr);
 /* idr index must be protected */
 static DEFINE_MUTEX(zram_index_mutex);
 
 static int zram_major;
+/* runs the slices of large write bios on other CPUs */
+static struct workqueue_struct *zram_batch_wq;
 static const char *default_compressor = CONFIG_ZRAM_DEFAULT_COMP_ALGORITHM;
 
 /* Module params (documentation at end) */
@@ -120,6 +125,36 @@ static unsigned long zram_get_element(struct zram *zram, u32 index)
 	return zram->table[index].element;
 }
 
+static inline void zram_set_entry(struct zram *zram, u32 index,
+			struct zram_entry *entry)
+{
+	zram->table[index].entry = entry;
+}
+
+static struct zram_entry *zram_get_entry(struct zram *zram, u32 index)
+{
+	return zram->table[index].entry;
+}
+
+/* zsmalloc handle of the slot's object, shared or not */
+static unsigned long zram_get_obj_handle(struct zram *zram, u32 index)
+{
+	if (zram_test_flag(zram, index, ZRAM_DEDUP))
+		return zram_get_entry(zram, index)->handle;
+
+	return zram_get_handle(zram, index);
+}
+
+/* compression backend the slot's object was encoded with */
+static struct zcomp *zram_get_comp(struct zram *zram, u32 index)
+{
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	if (zram_test_flag(zram, index, ZRAM_RECOMP))
+		return zram->recomp;
+#endif
+	return zram->comp;
+}
+
 static size_t zram_get_obj_size(struct zram *zram, u32 index)
 {
 	return zram->table[index].flags & (BIT(ZRAM_FLAG_SHIFT) - 1);
@@ -406,6 +441,256 @@ static ssize_t writeback_limit_show(struct device *dev,
 	return scnprintf(buf, PAGE_SIZE, "%llu\n", val);
 }
 
+/*
+ * Writeback lays out neighbouring slots on adjacent blocks, so when a
+ * written back slot is faulted in, its neighbours are read along with it
+ * in one bio into a small per-device cache of block pages. A later fault
+ * on one of them is then served from memory instead of a 4K random read.
+ * Cache entries are dropped when their block is freed.
+ */
+static void zram_ra_free(struct zram_ra_entry *cache)
+{
+	int i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < ZRAM_RA_CACHE_PAGES; i++) {
+		if (cache[i].page)
+			__free_page(cache[i].page);
+	}
+	kfree(cache);
+}
+
+static struct zram_ra_entry *zram_ra_alloc(void)
+{
+	struct zram_ra_entry *cache;
+	int i;
+
+	cache = kcalloc(ZRAM_RA_CACHE_PAGES, sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return NULL;
+
+	for (i = 0; i < ZRAM_RA_CACHE_PAGES; i++) {
+		cache[i].page = alloc_page(GFP_KERNEL);
+		if (!cache[i].page) {
+			zram_ra_free(cache);
+			return NULL;
+		}
+	}
+
+	return cache;
+}
+
+/* Must be called under ra_lock */
+static int zram_ra_find(struct zram *zram, unsigned long blk_idx)
+{
+	int i;
+
+	for (i = 0; i < ZRAM_RA_CACHE_PAGES; i++) {
+		if (zram->ra_cache[i].blk_idx == blk_idx)
+			return i;
+	}
+
+	return -1;
+}
+
+/* Must be called under ra_lock, entries with I/O in flight are skipped */
+static int zram_ra_claim(struct zram *zram, unsigned long blk_idx)
+{
+	struct zram_ra_entry *entry;
+	int n, i;
+
+	for (n = 0; n < ZRAM_RA_CACHE_PAGES; n++) {
+		i = zram->ra_next;
+		zram->ra_next = (zram->ra_next + 1) % ZRAM_RA_CACHE_PAGES;
+		entry = &zram->ra_cache[i];
+		if (entry->busy)
+			continue;
+
+		entry->blk_idx = blk_idx;
+		entry->uptodate = false;
+		entry->busy = true;
+		return i;
+	}
+
+	return -1;
+}
+
+static void zram_ra_invalidate(struct zram *zram, unsigned long blk_idx)
+{
+	unsigned long flags;
+	int i;
+
+	if (!zram->ra_cache)
+		return;
+
+	spin_lock_irqsave(&zram->ra_lock, flags);
+	i = zram_ra_find(zram, blk_idx);
+	if (i >= 0)
+		zram->ra_cache[i].blk_idx = 0;
+	spin_unlock_irqrestore(&zram->ra_lock, flags);
+}
+
+/* Returns true if @page was filled from the read-ahead cache */
+static bool zram_ra_read(struct zram *zram, struct page *page,
+			unsigned long blk_idx)
+{
+	struct zram_ra_entry *entry;
+	unsigned long flags;
+	bool hit = false;
+	void *src, *dst;
+	int i;
+
+	if (!zram->ra_cache)
+		return false;
+
+	spin_lock_irqsave(&zram->ra_lock, flags);
+	i = zram_ra_find(zram, blk_idx);
+	if (i >= 0 && zram->ra_cache[i].uptodate) {
+		entry = &zram->ra_cache[i];
+		src = kmap_atomic(entry->page);
+		dst = kmap_atomic(page);
+		memcpy(dst, src, PAGE_SIZE);
+		kunmap_atomic(dst);
+		kunmap_atomic(src);
+		hit = true;
+	}
+	spin_unlock_irqrestore(&zram->ra_lock, flags);
+
+	if (hit)
+		atomic64_inc(&zram->stats.bd_ra_hits);
+	return hit;
+}
+
+struct zram_ra_ctl {
+	struct zram *zram;
+	unsigned long blk_idx;		/* block of slots[0] */
+	unsigned int nr;
+	int slots[ZRAM_RA_PAGES];	/* ra_cache entries */
+};
+
+static void zram_ra_end_io(struct bio *bio)
+{
+	struct zram_ra_ctl *ctl = bio->bi_private;
+	struct zram *zram = ctl->zram;
+	struct zram_ra_entry *entry;
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&zram->ra_lock, flags);
+	for (i = 0; i < ctl->nr; i++) {
+		entry = &zram->ra_cache[ctl->slots[i]];
+		entry->busy = false;
+		/* block was freed meanwhile */
+		if (entry->blk_idx != ctl->blk_idx + i)
+			continue;
+
+		if (bio->bi_error || i >= bio->bi_vcnt)
+			entry->blk_idx = 0;
+		else
+			entry->uptodate = true;
+	}
+	if (!--zram->ra_inflight)
+		wake_up(&zram->ra_wait);
+	spin_unlock_irqrestore(&zram->ra_lock, flags);
+
+	bio_put(bio);
+	kfree(ctl);
+}
+
+/*
+ * Read ahead the written back slots following @index as long as they
+ * sit on the blocks following @blk_idx. Best effort: any failure just
+ * means no read-ahead.
+ */
+static void zram_bdev_readahead(struct zram *zram, u32 index,
+				unsigned long blk_idx)
+{
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	struct zram_ra_ctl *ctl;
+	unsigned long flags;
+	struct bio *bio;
+	unsigned int i, nr;
+	int slot;
+
+	if (!zram->ra_cache)
+		return;
+
+	for (nr = 0; nr < ZRAM_RA_PAGES; nr++) {
+		u32 next = index + nr + 1;
+		bool adjacent;
+
+		if (next >= nr_pages)
+			break;
+
+		zram_slot_lock(zram, next);
+		adjacent = zram_test_flag(zram, next, ZRAM_WB) &&
+			zram_get_element(zram, next) == blk_idx + nr + 1;
+		zram_slot_unlock(zram, next);
+		if (!adjacent)
+			break;
+	}
+
+	if (!nr)
+		return;
+
+	ctl = kmalloc(sizeof(*ctl), GFP_ATOMIC);
+	if (!ctl)
+		return;
+
+	ctl->zram = zram;
+	ctl->blk_idx = blk_idx + 1;
+
+	spin_lock_irqsave(&zram->ra_lock, flags);
+	for (i = 0; i < nr; i++) {
+		/* already cached or being read */
+		if (zram_ra_find(zram, ctl->blk_idx + i) >= 0)
+			break;
+		slot = zram_ra_claim(zram, ctl->blk_idx + i);
+		if (slot < 0)
+			break;
+		ctl->slots[i] = slot;
+	}
+	ctl->nr = i;
+	if (ctl->nr)
+		zram->ra_inflight++;
+	spin_unlock_irqrestore(&zram->ra_lock, flags);
+
+	if (!ctl->nr) {
+		kfree(ctl);
+		return;
+	}
+
+	bio = bio_alloc(GFP_ATOMIC, ctl->nr);
+	if (!bio) {
+		spin_lock_irqsave(&zram->ra_lock, flags);
+		for (i = 0; i < ctl->nr; i++) {
+			zram->ra_cache[ctl->slots[i]].busy = false;
+			zram->ra_cache[ctl->slots[i]].blk_idx = 0;
+		}
+		zram->ra_inflight--;
+		spin_unlock_irqrestore(&zram->ra_lock, flags);
+		kfree(ctl);
+		return;
+	}
+
+	bio->bi_iter.bi_sector = ctl->blk_idx * (PAGE_SIZE >> 9);
+	bio->bi_bdev = zram->bdev;
+	bio->bi_opf = REQ_OP_READ | REQ_RAHEAD;
+	bio->bi_end_io = zram_ra_end_io;
+	bio->bi_private = ctl;
+
+	/* entries that don't fit are dropped in zram_ra_end_io() */
+	for (i = 0; i < ctl->nr; i++) {
+		if (!bio_add_page(bio, zram->ra_cache[ctl->slots[i]].page,
+					PAGE_SIZE, 0))
+			break;
+	}
+
+	submit_bio(bio);
+}
+
 static void reset_bdev(struct zram *zram)
 {
 	struct block_device *bdev;
@@ -413,6 +698,13 @@ static void reset_bdev(struct zram *zram)
 	if (!zram->backing_dev)
 		return;
 
+	if (zram->ra_cache) {
+		wait_event(zram->ra_wait, !READ_ONCE(zram->ra_inflight));
+		/* let zram_ra_end_io() leave its critical section */
+		spin_lock_irq(&zram->ra_lock);
+		spin_unlock_irq(&zram->ra_lock);
+	}
+
 	bdev = zram->bdev;
 	if (zram->old_block_size)
 		set_blocksize(bdev, zram->old_block_size);
@@ -425,6 +717,8 @@ static void reset_bdev(struct zram *zram)
 
 	kvfree(zram->bitmap);
 	zram->bitmap = NULL;
+	zram_ra_free(zram->ra_cache);
+	zram->ra_cache = NULL;
 }
 
 static ssize_t backing_dev_show(struct device *dev,
@@ -466,6 +760,7 @@ static ssize_t backing_dev_store(struct device *dev,
 	struct address_space *mapping;
 	unsigned int bitmap_sz, old_block_size = 0;
 	unsigned long nr_pages, *bitmap = NULL;
+	struct zram_ra_entry *ra_cache = NULL;
 	struct block_device *bdev = NULL;
 	int err;
 	struct zram *zram = dev_to_zram(dev);
@@ -526,6 +821,12 @@ static ssize_t backing_dev_store(struct device *dev,
 		goto out;
 	}
 
+	ra_cache = zram_ra_alloc();
+	if (!ra_cache) {
+		err = -ENOMEM;
+		goto out;
+	}
+
 	old_block_size = block_size(bdev);
 	err = set_blocksize(bdev, PAGE_SIZE);
 	if (err)
@@ -538,6 +839,7 @@ static ssize_t backing_dev_store(struct device *dev,
 	zram->backing_dev = backing_dev;
 	zram->bitmap = bitmap;
 	zram->nr_pages = nr_pages;
+	zram->ra_cache = ra_cache;
 	up_write(&zram->init_lock);
 
 	pr_info("setup backing device %s\n", file_name);
@@ -545,6 +847,8 @@ static ssize_t backing_dev_store(struct device *dev,
 
 	return len;
 out:
+	zram_ra_free(ra_cache);
+
 	if (bitmap)
 		kvfree(bitmap);
 
@@ -561,14 +865,25 @@ static ssize_t backing_dev_store(struct device *dev,
 	return err;
 }
 
-static unsigned long alloc_block_bdev(struct zram *zram)
+/*
+ * Search for a free block starting at @hint, so that consecutive
+ * allocations by writeback end up on adjacent blocks.
+ */
+static unsigned long alloc_block_bdev(struct zram *zram, unsigned long hint)
 {
-	unsigned long blk_idx = 1;
-retry:
 	/* skip 0 bit to confuse zram.handle = 0 */
+	unsigned long blk_idx = max(hint, 1UL);
+retry:
 	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, blk_idx);
-	if (blk_idx == zram->nr_pages)
+	if (blk_idx == zram->nr_pages) {
+		/* wrap around once if we didn't start at the beginning */
+		if (hint > 1) {
+			hint = 0;
+			blk_idx = 1;
+			goto retry;
+		}
 		return 0;
+	}
 
 	if (test_and_set_bit(blk_idx, zram->bitmap))
 		goto retry;
@@ -581,6 +896,7 @@ static void free_block_bdev(struct zram *zram, unsigned long blk_idx)
 {
 	int was_set;
 
+	zram_ra_invalidate(zram, blk_idx);
 	was_set = test_and_clear_bit(blk_idx, zram->bitmap);
 	WARN_ON_ONCE(!was_set);
 	atomic64_dec(&zram->stats.bd_count);
@@ -625,6 +941,145 @@ static int read_from_bdev_async(struct zram *zram, struct bio_vec *bvec,
 	return 1;
 }
 
+/*
+ * Writeback builds bios of up to ZRAM_WB_BATCH_PAGES pages going to a run
+ * of adjacent blocks and keeps up to ZRAM_WB_MAX_INFLIGHT of them in
+ * flight. Slots are only switched to ZRAM_WB once their bio completed.
+ */
+#define ZRAM_WB_BATCH_PAGES	32
+#define ZRAM_WB_MAX_INFLIGHT	4
+
+struct zram_wb_ctl {
+	struct bio *bio;		/* non-NULL while in flight */
+	struct completion done;
+	unsigned long blk_idx;		/* block of pages[0] */
+	unsigned int nr_pages;
+	u32 index[ZRAM_WB_BATCH_PAGES];
+	struct page *pages[ZRAM_WB_BATCH_PAGES];
+};
+
+static void zram_wb_end_io(struct bio *bio)
+{
+	struct zram_wb_ctl *ctl = bio->bi_private;
+
+	complete(&ctl->done);
+}
+
+static void zram_wb_submit(struct zram *zram, struct zram_wb_ctl *ctl)
+{
+	struct bio *bio;
+	unsigned int i;
+
+	bio = bio_alloc(GFP_KERNEL, ctl->nr_pages);
+	bio->bi_iter.bi_sector = ctl->blk_idx * (PAGE_SIZE >> 9);
+	bio->bi_bdev = zram->bdev;
+	bio_set_op_attrs(bio, REQ_OP_WRITE, REQ_SYNC);
+	bio->bi_end_io = zram_wb_end_io;
+	bio->bi_private = ctl;
+
+	/* pages that don't fit are failed in zram_wb_complete() */
+	for (i = 0; i < ctl->nr_pages; i++) {
+		if (!bio_add_page(bio, ctl->pages[i], PAGE_SIZE, 0))
+			break;
+	}
+
+	ctl->bio = bio;
+	reinit_completion(&ctl->done);
+	submit_bio(bio);
+}
+
+static void zram_wb_complete(struct zram *zram, struct zram_wb_ctl *ctl)
+{
+	struct bio *bio = ctl->bio;
+	unsigned int i;
+
+	wait_for_completion_io(&ctl->done);
+
+	for (i = 0; i < ctl->nr_pages; i++) {
+		u32 index = ctl->index[i];
+		unsigned long blk_idx = ctl->blk_idx + i;
+
+		zram_slot_lock(zram, index);
+		if (bio->bi_error || i >= bio->bi_vcnt) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_clear_flag(zram, index, ZRAM_IDLE);
+			zram_slot_unlock(zram, index);
+			free_block_bdev(zram, blk_idx);
+			continue;
+		}
+
+		atomic64_inc(&zram->stats.bd_writes);
+		/*
+		 * We released zram_slot_lock so need to check if the slot was
+		 * changed. If there is freeing for the slot, we can catch it
+		 * easily by zram_allocated.
+		 * A subtle case is the slot is freed/reallocated/marked as
+		 * ZRAM_IDLE again. To close the race, idle_store doesn't
+		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
+		 * Thus, we could close the race by checking ZRAM_IDLE bit.
+		 */
+		if (!zram_allocated(zram, index) ||
+			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_clear_flag(zram, index, ZRAM_IDLE);
+			zram_slot_unlock(zram, index);
+			free_block_bdev(zram, blk_idx);
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_set_element(zram, index, blk_idx);
+		atomic64_inc(&zram->stats.pages_stored);
+		spin_lock(&zram->wb_limit_lock);
+		if (zram->wb_limit_enable && zram->bd_wb_limit > 0)
+			zram->bd_wb_limit -=  1UL << (PAGE_SHIFT - 12);
+		spin_unlock(&zram->wb_limit_lock);
+		zram_slot_unlock(zram, index);
+	}
+
+	bio_put(bio);
+	ctl->bio = NULL;
+	ctl->nr_pages = 0;
+}
+
+static void zram_wb_free_ctls(struct zram_wb_ctl *ctls)
+{
+	int i, j;
+
+	for (i = 0; i < ZRAM_WB_MAX_INFLIGHT; i++) {
+		for (j = 0; j < ZRAM_WB_BATCH_PAGES; j++) {
+			if (ctls[i].pages[j])
+				__free_page(ctls[i].pages[j]);
+		}
+	}
+	kfree(ctls);
+}
+
+static struct zram_wb_ctl *zram_wb_alloc_ctls(void)
+{
+	struct zram_wb_ctl *ctls;
+	int i, j;
+
+	ctls = kcalloc(ZRAM_WB_MAX_INFLIGHT, sizeof(*ctls), GFP_KERNEL);
+	if (!ctls)
+		return NULL;
+
+	for (i = 0; i < ZRAM_WB_MAX_INFLIGHT; i++) {
+		init_completion(&ctls[i].done);
+		for (j = 0; j < ZRAM_WB_BATCH_PAGES; j++) {
+			ctls[i].pages[j] = alloc_page(GFP_KERNEL);
+			if (!ctls[i].pages[j]) {
+				zram_wb_free_ctls(ctls);
+				return NULL;
+			}
+		}
+	}
+
+	return ctls;
+}
+
 #define HUGE_WRITEBACK 1
 #define IDLE_WRITEBACK 2
 
@@ -634,12 +1089,13 @@ static ssize_t writeback_store(struct device *dev,
 	struct zram *zram = dev_to_zram(dev);
 	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
 	unsigned long index;
-	struct bio bio;
-	struct page *page;
+	struct zram_wb_ctl *ctls, *ctl;
+	struct request_queue *q;
+	unsigned int i, cur = 0, batch, nr_pending = 0;
 	ssize_t ret, sz;
 	char mode_buf[8];
 	int mode = -1;
-	unsigned long blk_idx = 0;
+	unsigned long blk_idx, hint = 0;
 
 	sz = strscpy(mode_buf, buf, sizeof(mode_buf));
 	if (sz <= 0)
@@ -668,35 +1124,32 @@ static ssize_t writeback_store(struct device *dev,
 		goto release_init_lock;
 	}
 
-	page = alloc_page(GFP_KERNEL);
-	if (!page) {
+	ctls = zram_wb_alloc_ctls();
+	if (!ctls) {
 		ret = -ENOMEM;
 		goto release_init_lock;
 	}
 
+	q = bdev_get_queue(zram->bdev);
+	batch = min_t(unsigned int, ZRAM_WB_BATCH_PAGES,
+			queue_max_segments(q));
+	batch = min_t(unsigned int, batch,
+			queue_max_sectors(q) >> (PAGE_SHIFT - 9));
+	batch = max(batch, 1U);
+
+	ctl = &ctls[cur];
 	for (index = 0; index < nr_pages; index++) {
 		struct bio_vec bvec;
 
-		bvec.bv_page = page;
-		bvec.bv_len = PAGE_SIZE;
-		bvec.bv_offset = 0;
-
 		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && !zram->bd_wb_limit) {
+		if (zram->wb_limit_enable && zram->bd_wb_limit <=
+				(u64)nr_pending << (PAGE_SHIFT - 12)) {
 			spin_unlock(&zram->wb_limit_lock);
 			ret = -EIO;
 			break;
 		}
 		spin_unlock(&zram->wb_limit_lock);
 
-		if (!blk_idx) {
-			blk_idx = alloc_block_bdev(zram);
-			if (!blk_idx) {
-				ret = -ENOSPC;
-				break;
-			}
-		}
-
 		zram_slot_lock(zram, index);
 		if (!zram_allocated(zram, index))
 			goto next;
@@ -720,73 +1173,73 @@ static ssize_t writeback_store(struct device *dev,
 		/* Need for hugepage writeback racing */
 		zram_set_flag(zram, index, ZRAM_IDLE);
 		zram_slot_unlock(zram, index);
-		if (zram_bvec_read(zram, &bvec, index, 0, NULL)) {
+
+		blk_idx = alloc_block_bdev(zram, hint);
+		if (!blk_idx) {
 			zram_slot_lock(zram, index);
 			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 			zram_clear_flag(zram, index, ZRAM_IDLE);
 			zram_slot_unlock(zram, index);
-			continue;
+			ret = -ENOSPC;
+			break;
 		}
 
-		bio_init(&bio);
-
-		bio.bi_max_vecs = 1;
-		bio.bi_io_vec = &bvec;
-		bio.bi_bdev = zram->bdev;
+		/* a bio can only cover a run of adjacent blocks */
+		if (ctl->nr_pages &&
+				blk_idx != ctl->blk_idx + ctl->nr_pages) {
+			zram_wb_submit(zram, ctl);
+			cur = (cur + 1) % ZRAM_WB_MAX_INFLIGHT;
+			ctl = &ctls[cur];
+			if (ctl->bio) {
+				nr_pending -= ctl->nr_pages;
+				zram_wb_complete(zram, ctl);
+			}
+		}
 
-		bio.bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
-		bio_set_op_attrs(&bio, REQ_OP_WRITE, REQ_SYNC);
-		bio_add_page(&bio, bvec.bv_page, bvec.bv_len,
-				bvec.bv_offset);
-		/*
-		 * XXX: A single page IO would be inefficient for write
-		 * but it would be not bad as starter.
-		 */
-		ret = submit_bio_wait(&bio);
-		if (ret) {
+		bvec.bv_page = ctl->pages[ctl->nr_pages];
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		if (zram_bvec_read(zram, &bvec, index, 0, NULL)) {
 			zram_slot_lock(zram, index);
 			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 			zram_clear_flag(zram, index, ZRAM_IDLE);
 			zram_slot_unlock(zram, index);
+			free_block_bdev(zram, blk_idx);
 			continue;
 		}
 
-		atomic64_inc(&zram->stats.bd_writes);
-		/*
-		 * We released zram_slot_lock so need to check if the slot was
-		 * changed. If there is freeing for the slot, we can catch it
-		 * easily by zram_allocated.
-		 * A subtle case is the slot is freed/reallocated/marked as
-		 * ZRAM_IDLE again. To close the race, idle_store doesn't
-		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
-		 * Thus, we could close the race by checking ZRAM_IDLE bit.
-		 */
-		zram_slot_lock(zram, index);
-		if (!zram_allocated(zram, index) ||
-			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			goto next;
+		if (!ctl->nr_pages)
+			ctl->blk_idx = blk_idx;
+		ctl->index[ctl->nr_pages++] = index;
+		nr_pending++;
+		hint = blk_idx + 1;
+
+		if (ctl->nr_pages == batch) {
+			zram_wb_submit(zram, ctl);
+			cur = (cur + 1) % ZRAM_WB_MAX_INFLIGHT;
+			ctl = &ctls[cur];
+			if (ctl->bio) {
+				nr_pending -= ctl->nr_pages;
+				zram_wb_complete(zram, ctl);
+			}
 		}
-
-		zram_free_page(zram, index);
-		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-		zram_set_flag(zram, index, ZRAM_WB);
-		zram_set_element(zram, index, blk_idx);
-		blk_idx = 0;
-		atomic64_inc(&zram->stats.pages_stored);
-		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && zram->bd_wb_limit > 0)
-			zram->bd_wb_limit -=  1UL << (PAGE_SHIFT - 12);
-		spin_unlock(&zram->wb_limit_lock);
+		continue;
 next:
 		zram_slot_unlock(zram, index);
 	}
 
-	if (blk_idx)
-		free_block_bdev(zram, blk_idx);
+	if (ctl->nr_pages)
+		zram_wb_submit(zram, ctl);
+
+	/* reap the remaining bios in submission order */
+	for (i = 1; i <= ZRAM_WB_MAX_INFLIGHT; i++) {
+		ctl = &ctls[(cur + i) % ZRAM_WB_MAX_INFLIGHT];
+		if (ctl->bio)
+			zram_wb_complete(zram, ctl);
+	}
+
 	ret = len;
-	__free_page(page);
+	zram_wb_free_ctls(ctls);
 release_init_lock:
 	up_read(&zram->init_lock);
 
@@ -852,6 +1305,13 @@ static int read_from_bdev(struct zram *zram, struct bio_vec *bvec,
 		return read_from_bdev_async(zram, bvec, entry, parent);
 }
 #else
+static bool zram_ra_read(struct zram *zram, struct page *page,
+			unsigned long blk_idx)
+{
+	return false;
+}
+static void zram_bdev_readahead(struct zram *zram, u32 index,
+				unsigned long blk_idx) {};
 static inline void reset_bdev(struct zram *zram) {};
 static int read_from_bdev(struct zram *zram, struct bio_vec *bvec,
 			unsigned long entry, struct bio *parent, bool sync)
@@ -919,13 +1379,14 @@ static ssize_t read_block_state(struct file *file, char __user *buf,
 
 		ts = ktime_to_timespec64(zram->table[index].ac_time);
 		copied = snprintf(kbuf + written, count,
-			"%12zd %12lld.%06lu %c%c%c%c\n",
+			"%12zd %12lld.%06lu %c%c%c%c%c\n",
 			index, (s64)ts.tv_sec,
 			ts.tv_nsec / NSEC_PER_USEC,
 			zram_test_flag(zram, index, ZRAM_SAME) ? 's' : '.',
 			zram_test_flag(zram, index, ZRAM_WB) ? 'w' : '.',
 			zram_test_flag(zram, index, ZRAM_HUGE) ? 'h' : '.',
-			zram_test_flag(zram, index, ZRAM_IDLE) ? 'i' : '.');
+			zram_test_flag(zram, index, ZRAM_IDLE) ? 'i' : '.',
+			zram_test_flag(zram, index, ZRAM_RECOMP) ? 'r' : '.');
 
 		if (count <= copied) {
 			zram_slot_unlock(zram, index);
@@ -1040,6 +1501,84 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->recomp_algorithm, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	char compressor[ARRAY_SIZE(zram->recomp_algorithm)];
+	size_t sz;
+
+	strlcpy(compressor, buf, sizeof(compressor));
+	/* ignore trailing newline */
+	sz = strlen(compressor);
+	if (sz > 0 && compressor[sz - 1] == '\n')
+		compressor[sz - 1] = 0x00;
+
+	if (!zcomp_available_algorithm(compressor))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+
+	strcpy(zram->recomp_algorithm, compressor);
+	up_write(&zram->init_lock);
+	return len;
+}
+#endif
+
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+}
+
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int val;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (kstrtoint(buf, 10, &val) || (val != 0 && val != 1))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+#endif
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -1096,7 +1635,7 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
@@ -1104,7 +1643,10 @@ static ssize_t mm_stat_show(struct device *dev,
 			max_used << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.same_pages),
 			atomic_long_read(&pool_stats.pages_compacted),
-			(u64)atomic64_read(&zram->stats.huge_pages));
+			(u64)atomic64_read(&zram->stats.huge_pages),
+			(u64)atomic64_read(&zram->stats.dup_data_size),
+			(u64)atomic64_read(&zram->stats.dedup_hits),
+			(u64)atomic64_read(&zram->stats.recomp_pages));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1120,10 +1662,11 @@ static ssize_t bd_stat_show(struct device *dev,
 
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
-		"%8llu %8llu %8llu\n",
+		"%8llu %8llu %8llu %8llu\n",
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_count)),
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_reads)),
-			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)));
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)),
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_ra_hits)));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1164,6 +1707,7 @@ static void zram_meta_free(struct zram *zram, u64 disksize)
 	for (index = 0; index < num_pages; index++)
 		zram_free_page(zram, index);
 
+	zram_dedup_fini(zram);
 	zs_destroy_pool(zram->mem_pool);
 	vfree(zram->table);
 }
@@ -1183,6 +1727,12 @@ static bool zram_meta_alloc(struct zram *zram, u64 disksize)
 		return false;
 	}
 
+	if (zram_dedup_init(zram, num_pages)) {
+		zs_destroy_pool(zram->mem_pool);
+		vfree(zram->table);
+		return false;
+	}
+
 	if (!huge_class_size)
 		huge_class_size = zs_huge_class_size(zram->mem_pool);
 	return true;
@@ -1203,6 +1753,12 @@ static void zram_free_page(struct zram *zram, size_t index)
 	if (zram_test_flag(zram, index, ZRAM_IDLE))
 		zram_clear_flag(zram, index, ZRAM_IDLE);
 
+	if (zram_test_flag(zram, index, ZRAM_RECOMP)) {
+		zram_clear_flag(zram, index, ZRAM_RECOMP);
+		atomic64_dec(&zram->stats.recomp_pages);
+	}
+	zram_clear_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+
 	if (zram_test_flag(zram, index, ZRAM_HUGE)) {
 		zram_clear_flag(zram, index, ZRAM_HUGE);
 		atomic64_dec(&zram->stats.huge_pages);
@@ -1224,6 +1780,12 @@ static void zram_free_page(struct zram *zram, size_t index)
 		goto out;
 	}
 
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		zram_dedup_put(zram, zram_get_entry(zram, index));
+		goto out;
+	}
+
 	handle = zram_get_handle(zram, index);
 	if (!handle)
 		return;
@@ -1240,28 +1802,18 @@ static void zram_free_page(struct zram *zram, size_t index)
 		~(1UL << ZRAM_LOCK | 1UL << ZRAM_UNDER_WB));
 }
 
-static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
-				struct bio *bio, bool partial_io)
+/*
+ * Decode the slot's in-memory object into @page. Caller must hold the
+ * slot lock and must have ruled out ZRAM_WB.
+ */
+static int zram_read_from_zspool(struct zram *zram, struct page *page,
+				u32 index)
 {
 	int ret;
 	unsigned long handle;
 	unsigned int size;
 	void *src, *dst;
 
-	zram_slot_lock(zram, index);
-	if (zram_test_flag(zram, index, ZRAM_WB)) {
-		struct bio_vec bvec;
-
-		zram_slot_unlock(zram, index);
-
-		bvec.bv_page = page;
-		bvec.bv_len = PAGE_SIZE;
-		bvec.bv_offset = 0;
-		return read_from_bdev(zram, &bvec,
-				zram_get_element(zram, index),
-				bio, partial_io);
-	}
-
 	handle = zram_get_handle(zram, index);
 	if (!handle || zram_test_flag(zram, index, ZRAM_SAME)) {
 		unsigned long value;
@@ -1271,10 +1823,10 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		mem = kmap_atomic(page);
 		zram_fill_page(mem, PAGE_SIZE, value);
 		kunmap_atomic(mem);
-		zram_slot_unlock(zram, index);
 		return 0;
 	}
 
+	handle = zram_get_obj_handle(zram, index);
 	size = zram_get_obj_size(zram, index);
 
 	src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
@@ -1284,14 +1836,44 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		kunmap_atomic(dst);
 		ret = 0;
 	} else {
-		struct zcomp_strm *zstrm = zcomp_stream_get(zram->comp);
+		struct zcomp *comp = zram_get_comp(zram, index);
+		struct zcomp_strm *zstrm = zcomp_stream_get(comp);
 
 		dst = kmap_atomic(page);
 		ret = zcomp_decompress(zstrm, src, size, dst);
 		kunmap_atomic(dst);
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 	}
 	zs_unmap_object(zram->mem_pool, handle);
+
+	return ret;
+}
+
+static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
+				struct bio *bio, bool partial_io)
+{
+	int ret;
+
+	zram_slot_lock(zram, index);
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		struct bio_vec bvec;
+		unsigned long blk_idx = zram_get_element(zram, index);
+
+		zram_slot_unlock(zram, index);
+
+		if (zram_ra_read(zram, page, blk_idx))
+			return 0;
+
+		bvec.bv_page = page;
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		ret = read_from_bdev(zram, &bvec, blk_idx, bio, partial_io);
+		if (ret >= 0)
+			zram_bdev_readahead(zram, index, blk_idx);
+		return ret;
+	}
+
+	ret = zram_read_from_zspool(zram, page, index);
 	zram_slot_unlock(zram, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
@@ -1346,6 +1928,8 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	struct page *page = bvec->bv_page;
 	unsigned long element = 0;
 	enum zram_pageflags flags = 0;
+	struct zram_entry *entry = NULL;
+	u32 checksum = 0;
 
 	mem = kmap_atomic(page);
 	if (page_same_filled(mem, &element)) {
@@ -1357,6 +1941,14 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	}
 	kunmap_atomic(mem);
 
+	if (zram_dedup_enabled(zram)) {
+		entry = zram_dedup_find(zram, page, &checksum);
+		if (entry) {
+			comp_len = entry->len;
+			goto out;
+		}
+	}
+
 compress_again:
 	zstrm = zcomp_stream_get(zram->comp);
 	src = kmap_atomic(page);
@@ -1424,6 +2016,9 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	zcomp_stream_put(zram->comp);
 	zs_unmap_object(zram->mem_pool, handle);
 	atomic64_add(comp_len, &zram->stats.compr_data_size);
+
+	if (zram_dedup_enabled(zram))
+		entry = zram_dedup_new(zram, handle, comp_len, checksum);
 out:
 	/*
 	 * Free memory associated with this sector
@@ -1440,7 +2035,11 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	if (flags) {
 		zram_set_flag(zram, index, flags);
 		zram_set_element(zram, index, element);
-	}  else {
+	} else if (entry) {
+		zram_set_flag(zram, index, ZRAM_DEDUP);
+		zram_set_entry(zram, index, entry);
+		zram_set_obj_size(zram, index, comp_len);
+	} else {
 		zram_set_handle(zram, index, handle);
 		zram_set_obj_size(zram, index, comp_len);
 	}
@@ -1492,6 +2091,442 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	return ret;
 }
 
+/*
+ * Large write bios are split in slices of ZRAM_BATCH_PAGES pages. Each
+ * slice is compressed on a single stream with its zsmalloc objects
+ * allocated in the same pass, and then committed to the table with one
+ * slot lock round trip per page. Slices other than the first one are
+ * handed to other CPUs so a burst gets compressed in parallel.
+ */
+#define ZRAM_BATCH_PAGES	16
+
+struct zram_batch {
+	struct work_struct work;
+	struct zram *zram;
+	u32 index;			/* slot of pages[0], slots are contiguous */
+	unsigned int nr_pages;
+	int ret;
+	struct page *pages[ZRAM_BATCH_PAGES];
+	unsigned long handles[ZRAM_BATCH_PAGES];
+	unsigned int comp_lens[ZRAM_BATCH_PAGES];
+	unsigned long elements[ZRAM_BATCH_PAGES];
+};
+
+/* Called with the compression stream held, so we can't sleep here. */
+static int zram_batch_store(void *private, unsigned int i,
+			const void *buf, unsigned int comp_len)
+{
+	struct zram_batch *batch = private;
+	struct zram *zram = batch->zram;
+	unsigned long handle;
+	void *src, *dst;
+
+	if (comp_len >= huge_class_size)
+		comp_len = PAGE_SIZE;
+
+	handle = zs_malloc(zram->mem_pool, comp_len,
+			__GFP_KSWAPD_RECLAIM |
+			__GFP_NOWARN |
+			__GFP_HIGHMEM |
+			__GFP_MOVABLE |
+			__GFP_CMA);
+	/* Leave the page to the single page path which may reclaim */
+	if (!handle)
+		return 0;
+
+	dst = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+	src = (void *)buf;
+	if (comp_len == PAGE_SIZE)
+		src = kmap_atomic(batch->pages[i]);
+	memcpy(dst, src, comp_len);
+	if (comp_len == PAGE_SIZE)
+		kunmap_atomic(src);
+	zs_unmap_object(zram->mem_pool, handle);
+
+	batch->handles[i] = handle;
+	batch->comp_lens[i] = comp_len;
+	return 0;
+}
+
+static int zram_batch_write(struct zram_batch *batch)
+{
+	struct zram *zram = batch->zram;
+	struct page *cpages[ZRAM_BATCH_PAGES];
+	unsigned long alloced_pages;
+	u64 compr_size = 0, nr_same = 0, nr_huge = 0, nr_stored = 0;
+	unsigned int i;
+	int ret;
+
+	/* same filled pages need no compression, hide them from zcomp */
+	for (i = 0; i < batch->nr_pages; i++) {
+		void *mem = kmap_atomic(batch->pages[i]);
+
+		if (page_same_filled(mem, &batch->elements[i]))
+			cpages[i] = NULL;
+		else
+			cpages[i] = batch->pages[i];
+		kunmap_atomic(mem);
+	}
+
+	ret = zcomp_compress_batch(zram->comp, cpages, batch->nr_pages,
+				zram_batch_store, batch);
+	if (unlikely(ret)) {
+		pr_err("Compression failed! err=%d\n", ret);
+		goto free_handles;
+	}
+
+	alloced_pages = zs_get_total_pages(zram->mem_pool);
+	update_used_max(zram, alloced_pages);
+
+	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
+		ret = -ENOMEM;
+		goto free_handles;
+	}
+
+	for (i = 0; i < batch->nr_pages; i++) {
+		u32 index = batch->index + i;
+
+		if (cpages[i] && !batch->handles[i]) {
+			struct bio_vec bvec;
+
+			bvec.bv_page = cpages[i];
+			bvec.bv_len = PAGE_SIZE;
+			bvec.bv_offset = 0;
+			ret = __zram_bvec_write(zram, &bvec, index, NULL);
+			if (ret)
+				break;
+
+			zram_slot_lock(zram, index);
+			zram_accessed(zram, index);
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+
+		zram_slot_lock(zram, index);
+		zram_free_page(zram, index);
+		if (!cpages[i]) {
+			zram_set_flag(zram, index, ZRAM_SAME);
+			zram_set_element(zram, index, batch->elements[i]);
+			nr_same++;
+		} else {
+			if (batch->comp_lens[i] == PAGE_SIZE) {
+				zram_set_flag(zram, index, ZRAM_HUGE);
+				nr_huge++;
+			}
+			zram_set_handle(zram, index, batch->handles[i]);
+			zram_set_obj_size(zram, index, batch->comp_lens[i]);
+			compr_size += batch->comp_lens[i];
+			batch->handles[i] = 0;
+		}
+		zram_accessed(zram, index);
+		zram_slot_unlock(zram, index);
+		nr_stored++;
+	}
+
+	atomic64_add(compr_size, &zram->stats.compr_data_size);
+	atomic64_add(nr_same, &zram->stats.same_pages);
+	atomic64_add(nr_huge, &zram->stats.huge_pages);
+	atomic64_add(nr_stored, &zram->stats.pages_stored);
+
+free_handles:
+	for (i = 0; i < batch->nr_pages; i++) {
+		if (batch->handles[i])
+			zs_free(zram->mem_pool, batch->handles[i]);
+	}
+	return ret;
+}
+
+static void zram_batch_work(struct work_struct *work)
+{
+	struct zram_batch *batch = container_of(work, struct zram_batch, work);
+
+	batch->ret = zram_batch_write(batch);
+}
+
+/*
+ * The batched path only deals with whole, page aligned pages. Dedup
+ * lookups need the compression stream themselves, so they keep using
+ * the single page path.
+ */
+static bool zram_can_batch_write(struct zram *zram, struct bio *bio,
+				int offset)
+{
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+
+	if (!zram_batch_wq || zram_dedup_enabled(zram))
+		return false;
+
+	if (offset || bio->bi_iter.bi_size < 2 * PAGE_SIZE)
+		return false;
+
+	bio_for_each_segment(bvec, bio, iter) {
+		if (bvec.bv_len != PAGE_SIZE || bvec.bv_offset)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Returns -EAGAIN if the batch descriptors can't be allocated, in which
+ * case the caller should fall back to the single page path.
+ */
+static int zram_bio_write_batch(struct zram *zram, struct bio *bio, u32 index)
+{
+	unsigned long start_time = jiffies;
+	unsigned int nr_pages = bio->bi_iter.bi_size >> PAGE_SHIFT;
+	unsigned int nr_batches = DIV_ROUND_UP(nr_pages, ZRAM_BATCH_PAGES);
+	struct zram_batch *batches, *batch;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+	unsigned int i = 0;
+	int cpu, ret = 0;
+
+	batches = kcalloc(nr_batches, sizeof(*batches),
+			GFP_NOIO | __GFP_NOWARN);
+	if (!batches)
+		return -EAGAIN;
+
+	bio_for_each_segment(bvec, bio, iter) {
+		batch = &batches[i / ZRAM_BATCH_PAGES];
+		batch->pages[batch->nr_pages++] = bvec.bv_page;
+		i++;
+	}
+
+	generic_start_io_acct(REQ_OP_WRITE, bio_sectors(bio),
+			&zram->disk->part0);
+	atomic64_add(nr_pages, &zram->stats.num_writes);
+
+	/* Keep the first slice for ourselves, spread the others */
+	cpu = raw_smp_processor_id();
+	for (i = 0; i < nr_batches; i++) {
+		batch = &batches[i];
+		batch->zram = zram;
+		batch->index = index + i * ZRAM_BATCH_PAGES;
+		if (!i)
+			continue;
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		INIT_WORK(&batch->work, zram_batch_work);
+		queue_work_on(cpu, zram_batch_wq, &batch->work);
+	}
+
+	batches[0].ret = zram_batch_write(&batches[0]);
+
+	for (i = 0; i < nr_batches; i++) {
+		if (i)
+			flush_work(&batches[i].work);
+		if (batches[i].ret && !ret)
+			ret = batches[i].ret;
+	}
+
+	generic_end_io_acct(REQ_OP_WRITE, &zram->disk->part0, start_time);
+	if (unlikely(ret))
+		atomic64_inc(&zram->stats.failed_writes);
+
+	kfree(batches);
+	return ret;
+}
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+/*
+ * Re-encode the slot's object with the secondary algorithm and keep the
+ * result only if it is smaller. Called with the slot lock held, so the
+ * handle allocation must not enter direct reclaim.
+ */
+static int zram_recompress(struct zram *zram, u32 index, struct page *page)
+{
+	struct zcomp_strm *zstrm;
+	unsigned long handle;
+	unsigned int comp_len_old, comp_len_new;
+	bool idle;
+	void *src, *dst;
+	int ret;
+
+	comp_len_old = zram_get_obj_size(zram, index);
+	ret = zram_read_from_zspool(zram, page, index);
+	if (ret)
+		return ret;
+
+	zstrm = zcomp_stream_get(zram->recomp);
+	src = kmap_atomic(page);
+	ret = zcomp_compress(zstrm, src, &comp_len_new);
+	kunmap_atomic(src);
+
+	if (ret) {
+		zcomp_stream_put(zram->recomp);
+		return ret;
+	}
+
+	/*
+	 * Don't retry the slot on the next pass if the secondary algorithm
+	 * can't beat the primary one; it's cold data, it won't change.
+	 */
+	if (comp_len_new >= comp_len_old || comp_len_new >= huge_class_size) {
+		zcomp_stream_put(zram->recomp);
+		zram_set_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+		return 0;
+	}
+
+	handle = zs_malloc(zram->mem_pool, comp_len_new,
+			__GFP_KSWAPD_RECLAIM |
+			__GFP_NOWARN |
+			__GFP_HIGHMEM |
+			__GFP_MOVABLE |
+			__GFP_CMA);
+	if (!handle) {
+		zcomp_stream_put(zram->recomp);
+		return -ENOMEM;
+	}
+
+	dst = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+	memcpy(dst, zstrm->buffer, comp_len_new);
+	zcomp_stream_put(zram->recomp);
+	zs_unmap_object(zram->mem_pool, handle);
+
+	idle = zram_test_flag(zram, index, ZRAM_IDLE);
+	zram_free_page(zram, index);
+	zram_set_handle(zram, index, handle);
+	zram_set_obj_size(zram, index, comp_len_new);
+	zram_set_flag(zram, index, ZRAM_RECOMP);
+	if (idle)
+		zram_set_flag(zram, index, ZRAM_IDLE);
+
+	atomic64_add(comp_len_new, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.pages_stored);
+	atomic64_inc(&zram->stats.recomp_pages);
+
+	return 0;
+}
+
+#define RECOMPRESS_IDLE		(1 << 0)
+#define RECOMPRESS_HUGE		(1 << 1)
+
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long index;
+	struct page *page;
+	ssize_t ret, sz;
+	char mode_buf[16];
+	int mode = 0;
+
+	sz = strscpy(mode_buf, buf, sizeof(mode_buf));
+	if (sz <= 0)
+		return -EINVAL;
+
+	/* ignore trailing newline */
+	if (mode_buf[sz - 1] == '\n')
+		mode_buf[sz - 1] = 0x00;
+
+	if (!strcmp(mode_buf, "idle"))
+		mode = RECOMPRESS_IDLE;
+	else if (!strcmp(mode_buf, "huge"))
+		mode = RECOMPRESS_HUGE;
+	else if (!strcmp(mode_buf, "huge_idle"))
+		mode = RECOMPRESS_IDLE | RECOMPRESS_HUGE;
+
+	if (!mode)
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	if (!zram->recomp) {
+		ret = -ENODEV;
+		goto release_init_lock;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	ret = len;
+	for (index = 0; index < nr_pages; index++) {
+		int err;
+
+		zram_slot_lock(zram, index);
+		if (!zram_allocated(zram, index))
+			goto next;
+
+		/*
+		 * Shared dedup objects are decoded with the primary
+		 * algorithm by every slot referencing them, leave them be.
+		 */
+		if (zram_test_flag(zram, index, ZRAM_WB) ||
+				zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+				zram_test_flag(zram, index, ZRAM_SAME) ||
+				zram_test_flag(zram, index, ZRAM_DEDUP) ||
+				zram_test_flag(zram, index, ZRAM_RECOMP) ||
+				zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
+			goto next;
+
+		if ((mode & RECOMPRESS_IDLE) &&
+				!zram_test_flag(zram, index, ZRAM_IDLE))
+			goto next;
+		if ((mode & RECOMPRESS_HUGE) &&
+				!zram_test_flag(zram, index, ZRAM_HUGE))
+			goto next;
+
+		err = zram_recompress(zram, index, page);
+		zram_slot_unlock(zram, index);
+		if (err) {
+			ret = err;
+			break;
+		}
+
+		cond_resched();
+		continue;
+next:
+		zram_slot_unlock(zram, index);
+	}
+
+	__free_page(page);
+release_init_lock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static int zram_recomp_create(struct zram *zram)
+{
+	struct zcomp *comp;
+
+	if (!zram->recomp_algorithm[0])
+		return 0;
+
+	comp = zcomp_create(zram->recomp_algorithm);
+	if (IS_ERR(comp)) {
+		pr_err("Cannot initialise %s recompression backend\n",
+				zram->recomp_algorithm);
+		return PTR_ERR(comp);
+	}
+
+	zram->recomp = comp;
+	return 0;
+}
+
+static void zram_recomp_destroy(struct zram *zram)
+{
+	if (zram->recomp)
+		zcomp_destroy(zram->recomp);
+	zram->recomp = NULL;
+}
+#else
+static inline int zram_recomp_create(struct zram *zram) { return 0; }
+static inline void zram_recomp_destroy(struct zram *zram) {}
+#endif
+
 /*
  * zram_bio_discard - handler on discard request
  * @index: physical block index in PAGE_SIZE units
@@ -1587,6 +2622,18 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		return;
 	}
 
+	if (op_is_write(bio_op(bio)) &&
+			zram_can_batch_write(zram, bio, offset)) {
+		int ret = zram_bio_write_batch(zram, bio, index);
+
+		if (ret != -EAGAIN) {
+			if (ret)
+				goto out;
+			bio_endio(bio);
+			return;
+		}
+	}
+
 	bio_for_each_segment(bvec, bio, iter) {
 		struct bio_vec bv = bvec;
 		unsigned int unwritten = bvec.bv_len;
@@ -1725,6 +2772,7 @@ static void zram_reset_device(struct zram *zram)
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zcomp_destroy(comp);
+	zram_recomp_destroy(zram);
 	reset_bdev(zram);
 }
 
@@ -1762,6 +2810,10 @@ static ssize_t disksize_store(struct device *dev,
 	}
 
 	zram->comp = comp;
+	err = zram_recomp_create(zram);
+	if (err)
+		goto out_free_comp;
+
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
@@ -1770,6 +2822,9 @@ static ssize_t disksize_store(struct device *dev,
 
 	return len;
 
+out_free_comp:
+	zcomp_destroy(comp);
+	zram->comp = NULL;
 out_free_meta:
 	zram_meta_free(zram, disksize);
 out_unlock:
@@ -1853,6 +2908,13 @@ static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_WO(idle);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(recompress);
+#endif
+#ifdef CONFIG_ZRAM_DEDUP
+static DEVICE_ATTR_RW(use_dedup);
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
 static DEVICE_ATTR_WO(writeback);
@@ -1870,6 +2932,13 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_idle.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
+#endif
+#ifdef CONFIG_ZRAM_DEDUP
+	&dev_attr_use_dedup.attr,
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
 	&dev_attr_writeback.attr,
@@ -1916,6 +2985,8 @@ static int zram_add(void)
 	init_rwsem(&zram->init_lock);
 #ifdef CONFIG_ZRAM_WRITEBACK
 	spin_lock_init(&zram->wb_limit_lock);
+	spin_lock_init(&zram->ra_lock);
+	init_waitqueue_head(&zram->ra_wait);
 #endif
 	queue = blk_alloc_queue(GFP_KERNEL);
 	if (!queue) {
@@ -2108,6 +3179,8 @@ static void destroy_devices(void)
 	zram_debugfs_destroy();
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
+	if (zram_batch_wq)
+		destroy_workqueue(zram_batch_wq);
 }
 
 static int __init zram_init(void)
@@ -2120,11 +3193,23 @@ static int __init zram_init(void)
 		return ret;
 	}
 
+	/*
+	 * Swap-out may depend on this queue making progress, hence
+	 * WQ_MEM_RECLAIM. If it can't be created large writes just stay
+	 * on the single page path.
+	 */
+	zram_batch_wq = alloc_workqueue("zram_batch",
+					WQ_MEM_RECLAIM | WQ_HIGHPRI, 0);
+	if (!zram_batch_wq)
+		pr_warn("Unable to create batch workqueue\n");
+
 	zram_debugfs_create();
 	zram_major = register_blkdev(0, "zram");
 	if (zram_major <= 0) {
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
+		if (zram_batch_wq)
+			destroy_workqueue(zram_batch_wq);
 		return -EBUSY;
 	}
 
@@ -16,6 +16,7 @@
 #define _ZRAM_DRV_H_
 
 #include <linux/rwsem.h>
+#include <linux/rbtree.h>
 #include <linux/zsmalloc.h>
 #include <linux/crypto.h>
 
@@ -38,8 +39,11 @@
  * footprint small so we can squeeze size and flags into a field.
  * The lower ZRAM_FLAG_SHIFT bits is for object size (excluding header),
  * the higher bits is for zram_pageflags.
+ *
+ * Object size never exceeds PAGE_SIZE, so PAGE_SHIFT + 1 bits are enough
+ * and leave room for more page flags on 32-bit.
  */
-#define ZRAM_FLAG_SHIFT 24
+#define ZRAM_FLAG_SHIFT (PAGE_SHIFT + 1)
 
 /* Flags for zram pages (table[page_no].flags) */
 enum zram_pageflags {
@@ -50,17 +54,48 @@ enum zram_pageflags {
 	ZRAM_UNDER_WB,	/* page is under writeback */
 	ZRAM_HUGE,	/* Incompressible page */
 	ZRAM_IDLE,	/* not accessed page since last idle marking */
+	ZRAM_DEDUP,	/* page shares a zram_entry with other slots */
+	ZRAM_RECOMP,	/* page is compressed with the secondary algorithm */
+	ZRAM_INCOMPRESSIBLE, /* secondary algorithm couldn't shrink it */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/* Compressed object shared by all slots with identical content */
+struct zram_entry {
+	struct rb_node rb_node;
+	u32 len;
+	u32 checksum;
+	unsigned long refcount;
+	unsigned long handle;
+};
+
+struct zram_hash {
+	spinlock_t lock;
+	struct rb_root rb_root;
+};
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Size of the backing device read-ahead cache and of one read-ahead */
+#define ZRAM_RA_CACHE_PAGES	64
+#define ZRAM_RA_PAGES		8
+
+struct zram_ra_entry {
+	unsigned long blk_idx;	/* 0 if unused */
+	struct page *page;
+	bool uptodate;
+	bool busy;		/* read in flight, can't be recycled */
+};
+#endif
+
 /* Allocated for each disk page */
 struct zram_table_entry {
 	union {
 		unsigned long handle;
 		unsigned long element;
+		struct zram_entry *entry;	/* ZRAM_DEDUP */
 	};
 	unsigned long flags;
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
@@ -82,10 +117,14 @@ struct zram_stats {
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
 	atomic64_t miss_free;		/* no. of missed free */
+	atomic64_t dup_data_size;	/* compressed bytes saved by dedup */
+	atomic64_t dedup_hits;		/* no. of writes served by dedup */
+	atomic64_t recomp_pages;	/* no. of pages in secondary algorithm */
 #ifdef	CONFIG_ZRAM_WRITEBACK
 	atomic64_t bd_count;		/* no. of pages in backing device */
 	atomic64_t bd_reads;		/* no. of reads from backing device */
 	atomic64_t bd_writes;		/* no. of writes from backing device */
+	atomic64_t bd_ra_hits;		/* no. of reads served by read-ahead */
 #endif
 };
 
@@ -108,10 +147,20 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 	char compressor[CRYPTO_MAX_ALG_NAME];
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	/* secondary algorithm used by recompression, empty if unset */
+	struct zcomp *recomp;
+	char recomp_algorithm[CRYPTO_MAX_ALG_NAME];
+#endif
 	/*
 	 * zram is claimed so open request will be failed
 	 */
 	bool claim; /* Protected by bdev->bd_mutex */
+#ifdef CONFIG_ZRAM_DEDUP
+	bool use_dedup;
+	struct zram_hash *hash;
+	size_t hash_size;
+#endif
 	struct file *backing_dev;
 #ifdef CONFIG_ZRAM_WRITEBACK
 	spinlock_t wb_limit_lock;
@@ -121,6 +170,11 @@ struct zram {
 	unsigned int old_block_size;
 	unsigned long *bitmap;
 	unsigned long nr_pages;
+	spinlock_t ra_lock;
+	unsigned int ra_next;	/* next read-ahead entry to recycle */
+	unsigned int ra_inflight;	/* read-ahead bios, under ra_lock */
+	wait_queue_head_t ra_wait;
+	struct zram_ra_entry *ra_cache;
 #endif
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
 	struct dentry *debugfs_dir;
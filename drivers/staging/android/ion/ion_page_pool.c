@@ -21,6 +21,8 @@
 #include <linux/fs.h>
 #include <linux/list.h>
 #include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/vmalloc.h>
@@ -55,9 +57,35 @@ static void ion_page_pool_free_pages(struct ion_page_pool *pool,
 	__free_pages(page, pool->order);
 }
 
-static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
+/*
+ * Per-cpu magazines sit in front of the shared lists so that runs of
+ * small allocations and frees don't bounce pool->mutex between cpus.
+ * Pages move between a magazine and the lists in batches. Each magazine
+ * has its own lock, which is only ever contended by the shrinker or by
+ * someone adding up the pool.
+ */
+#define ION_POOL_MAG_BYTES	SZ_256K
+#define ION_POOL_MAG_MAX	64
+
+struct ion_page_pool_mag {
+	spinlock_t lock;
+	unsigned int count;
+	unsigned long mag_hits;
+	unsigned long list_hits;
+	unsigned long misses;
+	struct page *pages[ION_POOL_MAG_MAX];
+};
+
+static void ion_page_pool_account(struct ion_page_pool *pool,
+				  struct page *page, int sign)
+{
+	mod_node_page_state(page_pgdat(page), NR_INDIRECTLY_RECLAIMABLE_BYTES,
+			    sign * (1 << (PAGE_SHIFT + pool->order)));
+}
+
+/* Must be called with pool->mutex held */
+static void __ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
 {
-	mutex_lock(&pool->mutex);
 	if (PageHighMem(page)) {
 		list_add_tail(&page->lru, &pool->high_items);
 		pool->high_count++;
@@ -65,9 +93,12 @@ static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
 		list_add_tail(&page->lru, &pool->low_items);
 		pool->low_count++;
 	}
+}
 
-	mod_node_page_state(page_pgdat(page), NR_INDIRECTLY_RECLAIMABLE_BYTES,
-			    (1 << (PAGE_SHIFT + pool->order)));
+static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
+{
+	mutex_lock(&pool->mutex);
+	__ion_page_pool_add(pool, page);
 	mutex_unlock(&pool->mutex);
 	return 0;
 }
@@ -87,27 +118,166 @@ static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high)
 	}
 
 	list_del(&page->lru);
-	mod_node_page_state(page_pgdat(page), NR_INDIRECTLY_RECLAIMABLE_BYTES,
-			    -(1 << (PAGE_SHIFT + pool->order)));
 	return page;
 }
 
-void *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
+static struct page *ion_page_pool_mag_get(struct ion_page_pool *pool)
 {
+	struct ion_page_pool_mag *mag;
 	struct page *page = NULL;
 
-	BUG_ON(!pool);
+	if (!pool->mags)
+		return NULL;
 
-	*from_pool = true;
+	mag = raw_cpu_ptr(pool->mags);
+	spin_lock(&mag->lock);
+	if (mag->count)
+		page = mag->pages[--mag->count];
+	spin_unlock(&mag->lock);
+
+	if (page)
+		this_cpu_inc(pool->mags->mag_hits);
+	return page;
+}
+
+/*
+ * Stash the leftovers of a batch taken from the lists. Whatever doesn't
+ * fit, because we raced with a free on this cpu, goes back to the lists.
+ */
+static void ion_page_pool_mag_stash(struct ion_page_pool *pool,
+				    struct page **pages, int nr)
+{
+	struct ion_page_pool_mag *mag = raw_cpu_ptr(pool->mags);
+
+	spin_lock(&mag->lock);
+	while (nr && mag->count < pool->mag_size)
+		mag->pages[mag->count++] = pages[--nr];
+	spin_unlock(&mag->lock);
+
+	if (!nr)
+		return;
+
+	mutex_lock(&pool->mutex);
+	while (nr)
+		__ion_page_pool_add(pool, pages[--nr]);
+	mutex_unlock(&pool->mutex);
+}
+
+/*
+ * Take a batch of items from the lists, hand out the first and keep the
+ * rest in this cpu's magazine. Like before, a contended mutex is treated
+ * as a miss rather than waited for.
+ */
+static struct page *ion_page_pool_get_batch(struct ion_page_pool *pool)
+{
+	struct page *pages[ION_POOL_MAG_MAX / 2];
+	int nr = 0;
+
+	if (!mutex_trylock(&pool->mutex))
+		return NULL;
 
-	if (mutex_trylock(&pool->mutex)) {
+	while (nr < pool->mag_batch) {
 		if (pool->high_count)
-			page = ion_page_pool_remove(pool, true);
+			pages[nr++] = ion_page_pool_remove(pool, true);
 		else if (pool->low_count)
-			page = ion_page_pool_remove(pool, false);
+			pages[nr++] = ion_page_pool_remove(pool, false);
+		else
+			break;
+	}
+	mutex_unlock(&pool->mutex);
+
+	if (!nr)
+		return NULL;
+
+	if (nr > 1)
+		ion_page_pool_mag_stash(pool, pages + 1, nr - 1);
+	if (pool->mags)
+		this_cpu_inc(pool->mags->list_hits);
+	return pages[0];
+}
+
+static struct page *ion_page_pool_get(struct ion_page_pool *pool)
+{
+	struct page *page;
+
+	page = ion_page_pool_mag_get(pool);
+	if (!page)
+		page = ion_page_pool_get_batch(pool);
+	if (page)
+		ion_page_pool_account(pool, page, -1);
+	return page;
+}
+
+/*
+ * Put @page into this cpu's magazine. A full magazine first has half of
+ * its items moved back to the lists under a single mutex acquisition.
+ */
+static void ion_page_pool_put(struct ion_page_pool *pool, struct page *page)
+{
+	struct page *pages[ION_POOL_MAG_MAX / 2];
+	struct ion_page_pool_mag *mag;
+	int nr = 0;
+
+	ion_page_pool_account(pool, page, 1);
+
+	if (!pool->mags) {
+		ion_page_pool_add(pool, page);
+		return;
+	}
+
+	mag = raw_cpu_ptr(pool->mags);
+	spin_lock(&mag->lock);
+	if (mag->count == pool->mag_size) {
+		nr = pool->mag_batch;
+		mag->count -= nr;
+		memcpy(pages, &mag->pages[mag->count], nr * sizeof(*pages));
+	}
+	mag->pages[mag->count++] = page;
+	spin_unlock(&mag->lock);
+
+	if (!nr)
+		return;
+
+	mutex_lock(&pool->mutex);
+	while (nr)
+		__ion_page_pool_add(pool, pages[--nr]);
+	mutex_unlock(&pool->mutex);
+}
+
+void ion_page_pool_drain_mags(struct ion_page_pool *pool)
+{
+	struct ion_page_pool_mag *mag;
+	int cpu;
+
+	if (!pool->mags)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		mag = per_cpu_ptr(pool->mags, cpu);
+		if (!READ_ONCE(mag->count))
+			continue;
+
+		mutex_lock(&pool->mutex);
+		spin_lock(&mag->lock);
+		while (mag->count)
+			__ion_page_pool_add(pool, mag->pages[--mag->count]);
+		spin_unlock(&mag->lock);
 		mutex_unlock(&pool->mutex);
 	}
+}
+
+void *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
+{
+	struct page *page = NULL;
+
+	BUG_ON(!pool);
+
+	*from_pool = true;
+
+	page = ion_page_pool_get(pool);
 	if (!page) {
+		if (pool->mags)
+			this_cpu_inc(pool->mags->misses);
 		page = ion_page_pool_alloc_pages(pool);
 		*from_pool = false;
 	}
@@ -119,29 +289,15 @@ void *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
  */
 void *ion_page_pool_alloc_pool_only(struct ion_page_pool *pool)
 {
-	struct page *page = NULL;
-
 	if (!pool)
 		return NULL;
 
-	if (mutex_trylock(&pool->mutex)) {
-		if (pool->high_count)
-			page = ion_page_pool_remove(pool, true);
-		else if (pool->low_count)
-			page = ion_page_pool_remove(pool, false);
-		mutex_unlock(&pool->mutex);
-	}
-
-	return page;
+	return ion_page_pool_get(pool);
 }
 
 void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
 {
-	int ret;
-
-	ret = ion_page_pool_add(pool, page);
-	if (ret)
-		ion_page_pool_free_pages(pool, page);
+	ion_page_pool_put(pool, page);
 }
 
 void ion_page_pool_free_immediate(struct ion_page_pool *pool, struct page *page)
@@ -149,16 +305,44 @@ void ion_page_pool_free_immediate(struct ion_page_pool *pool, struct page *page)
 	ion_page_pool_free_pages(pool, page);
 }
 
+/*
+ * Magazine contents are read without their locks, so like the list counts
+ * the result is only a snapshot.
+ */
 int ion_page_pool_total(struct ion_page_pool *pool, bool high)
 {
 	int count = pool->low_count;
+	int cpu;
 
 	if (high)
 		count += pool->high_count;
 
+	if (pool->mags)
+		for_each_possible_cpu(cpu)
+			count += READ_ONCE(per_cpu_ptr(pool->mags, cpu)->count);
+
 	return count << pool->order;
 }
 
+void ion_page_pool_get_stats(struct ion_page_pool *pool,
+			     struct ion_page_pool_stats *stats)
+{
+	struct ion_page_pool_mag *mag;
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!pool->mags)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		mag = per_cpu_ptr(pool->mags, cpu);
+		stats->mag_hits += READ_ONCE(mag->mag_hits);
+		stats->list_hits += READ_ONCE(mag->list_hits);
+		stats->misses += READ_ONCE(mag->misses);
+		stats->mag_count += READ_ONCE(mag->count);
+	}
+}
+
 int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 				int nr_to_scan)
 {
@@ -173,6 +357,8 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 	if (nr_to_scan == 0)
 		return ion_page_pool_total(pool, high);
 
+	ion_page_pool_drain_mags(pool);
+
 	while (freed < nr_to_scan) {
 		struct page *page;
 
@@ -186,6 +372,7 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 			break;
 		}
 		mutex_unlock(&pool->mutex);
+		ion_page_pool_account(pool, page, -1);
 		ion_page_pool_free_pages(pool, page);
 		freed += (1 << pool->order);
 	}
@@ -193,10 +380,30 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 	return freed;
 }
 
+int ion_page_pool_refill(struct ion_page_pool *pool, gfp_t gfp_mask)
+{
+	struct page *page;
+
+	page = alloc_pages(gfp_mask & ~__GFP_ZERO, pool->order);
+	if (!page)
+		return -ENOMEM;
+
+	if (msm_ion_heap_high_order_page_zero(pool->dev, page, pool->order)) {
+		__free_pages(page, pool->order);
+		return -ENOMEM;
+	}
+
+	ion_page_pool_alloc_set_cache_policy(pool, page);
+	ion_page_pool_account(pool, page, 1);
+	ion_page_pool_add(pool, page);
+	return 0;
+}
+
 struct ion_page_pool *ion_page_pool_create(struct device *dev, gfp_t gfp_mask,
 					   unsigned int order)
 {
 	struct ion_page_pool *pool = kmalloc(sizeof(*pool), GFP_KERNEL);
+	int cpu;
 
 	if (!pool)
 		return NULL;
@@ -210,11 +417,35 @@ struct ion_page_pool *ion_page_pool_create(struct device *dev, gfp_t gfp_mask,
 	mutex_init(&pool->mutex);
 	plist_node_init(&pool->list, order);
 
+	/*
+	 * Large orders are allocated rarely enough that a magazine would only
+	 * strand memory, so they keep going straight to the lists.
+	 */
+	pool->mag_size = min_t(unsigned int,
+			       ION_POOL_MAG_BYTES >> (PAGE_SHIFT + order),
+			       ION_POOL_MAG_MAX);
+	pool->mag_batch = 1;
+	pool->mags = NULL;
+	if (pool->mag_size > 1)
+		pool->mags = alloc_percpu(struct ion_page_pool_mag);
+	if (!pool->mags)
+		return pool;
+
+	pool->mag_batch = pool->mag_size / 2;
+	for_each_possible_cpu(cpu) {
+		struct ion_page_pool_mag *mag = per_cpu_ptr(pool->mags, cpu);
+
+		spin_lock_init(&mag->lock);
+		mag->count = 0;
+	}
+
 	return pool;
 }
 
 void ion_page_pool_destroy(struct ion_page_pool *pool)
 {
+	ion_page_pool_drain_mags(pool);
+	free_percpu(pool->mags);
 	kfree(pool);
 }
 
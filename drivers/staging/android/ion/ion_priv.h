@@ -448,6 +448,8 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  * many systems
  */
 
+struct ion_page_pool_mag;
+
 /**
  * struct ion_page_pool - pagepool struct
  * @high_count:		number of highmem items in the pool
@@ -459,6 +461,11 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  * @gfp_mask:		gfp_mask to use from alloc
  * @order:		order of pages in the pool
  * @list:		plist node for list of pools
+ * @mags:		per-cpu magazines of items in front of the lists, or
+ *			NULL for orders too large to be worth caching per cpu
+ * @mag_size:		capacity of each magazine
+ * @mag_batch:		number of items moved between a magazine and the
+ *			lists at a time
  *
  * Allows you to keep a pool of pre allocated pages to use from your heap.
  * Keeping a pool of pages that is ready for dma, ie any cached mapping have
@@ -475,6 +482,23 @@ struct ion_page_pool {
 	gfp_t gfp_mask;
 	unsigned int order;
 	struct plist_node list;
+	struct ion_page_pool_mag __percpu *mags;
+	unsigned int mag_size;
+	int mag_batch;
+};
+
+/**
+ * struct ion_page_pool_stats - pool hit counters summed over all cpus
+ * @mag_hits:		allocations served from a per-cpu magazine
+ * @list_hits:		allocations that refilled a magazine from the lists
+ * @misses:		allocations that had to go to the page allocator
+ * @mag_count:		items currently held in magazines
+ */
+struct ion_page_pool_stats {
+	unsigned long mag_hits;
+	unsigned long list_hits;
+	unsigned long misses;
+	unsigned long mag_count;
 };
 
 struct ion_page_pool *ion_page_pool_create(struct device *dev, gfp_t gfp_mask,
@@ -485,6 +509,8 @@ void *ion_page_pool_alloc_pool_only(struct ion_page_pool *a);
 void ion_page_pool_free(struct ion_page_pool *a, struct page *b);
 void ion_page_pool_free_immediate(struct ion_page_pool *, struct page *);
 int ion_page_pool_total(struct ion_page_pool *pool, bool high);
+void ion_page_pool_get_stats(struct ion_page_pool *pool,
+			     struct ion_page_pool_stats *stats);
 size_t ion_system_heap_secure_page_pool_total(struct ion_heap *heap, int vmid);
 
 #ifdef CONFIG_ION_POOL_CACHE_POLICY
@@ -527,6 +553,22 @@ static inline void ion_page_pool_free_set_cache_policy
 int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 			  int nr_to_scan);
 
+/** ion_page_pool_refill - adds one zeroed item to the pool
+ * @pool:		the pool
+ * @gfp_mask:		flags to allocate the item with
+ *
+ * Does the allocation, zeroing and cache maintenance of a pool miss ahead
+ * of time. Returns 0 on success or -ENOMEM.
+ */
+int ion_page_pool_refill(struct ion_page_pool *pool, gfp_t gfp_mask);
+
+/** ion_page_pool_drain_mags - moves all per-cpu cached items to the lists
+ * @pool:		the pool
+ *
+ * Makes every item reachable from any cpu, e.g. before emptying the pool.
+ */
+void ion_page_pool_drain_mags(struct ion_page_pool *pool);
+
 /**
  * ion_pages_sync_for_device - cache flush pages for use with the specified
  *                             device
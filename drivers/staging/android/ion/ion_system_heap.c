@@ -19,7 +19,10 @@
 #include <linux/dma-mapping.h>
 #include <linux/err.h>
 #include <linux/highmem.h>
+#include <linux/freezer.h>
+#include <linux/kthread.h>
 #include <linux/mm.h>
+#include <linux/moduleparam.h>
 #include <linux/msm_ion.h>
 #include <linux/scatterlist.h>
 #include <linux/seq_file.h>
@@ -45,6 +48,22 @@ static const unsigned int orders[] = {9, 4, 0};
 static const unsigned int orders[] = {0};
 #endif
 
+/*
+ * Size in kB each non-secure pool of orders[i] is kept at by the refill
+ * thread, so allocations find zeroed pages instead of going to buddy.
+ * Every heap has a cached and an uncached pool per order, so this pins
+ * twice the sum of the watermarks per heap; off unless set.
+ */
+#ifndef CONFIG_ALLOC_BUFFERS_IN_4K_CHUNKS
+static unsigned int pool_watermark_kb[] = {0, 0, 0};
+#else
+static unsigned int pool_watermark_kb[] = {0};
+#endif
+module_param_array(pool_watermark_kb, uint, NULL, 0644);
+
+/* Refill is suspended for this long after the shrinker last ran */
+#define ION_POOL_REFILL_BACKOFF		(10 * HZ)
+
 static const int num_orders = ARRAY_SIZE(orders);
 static int order_to_index(unsigned int order)
 {
@@ -68,6 +87,9 @@ struct ion_system_heap {
 	struct ion_page_pool **secure_pools[VMID_LAST];
 	/* Prevents unnecessary page splitting */
 	struct mutex split_page_mutex;
+	struct task_struct *refill_task;
+	wait_queue_head_t refill_wait;
+	unsigned long refill_resume;
 };
 
 struct page_info {
@@ -481,6 +503,8 @@ static int ion_system_heap_allocate(struct ion_heap *heap,
 	if (nents_sync)
 		sg_free_table(&table_sync);
 	msm_ion_heap_free_pages_mem(&data);
+	if (sys_heap->refill_task && waitqueue_active(&sys_heap->refill_wait))
+		wake_up(&sys_heap->refill_wait);
 	return 0;
 
 err_free_sg2:
@@ -568,6 +592,7 @@ static int ion_secure_page_pool_shrink(
 	if (nr_to_scan == 0)
 		return ion_page_pool_total(pool, true);
 
+	ion_page_pool_drain_mags(pool);
 	while (freed < nr_to_scan) {
 		page = ion_page_pool_alloc_pool_only(pool);
 		if (!page)
@@ -627,6 +652,9 @@ static int ion_system_heap_shrink(struct ion_heap *heap, gfp_t gfp_mask,
 
 	sys_heap = container_of(heap, struct ion_system_heap, heap);
 
+	/* Being counted is enough, reclaim is about to want these pages */
+	WRITE_ONCE(sys_heap->refill_resume, jiffies + ION_POOL_REFILL_BACKOFF);
+
 	if (!nr_to_scan)
 		only_scan = 1;
 
@@ -668,6 +696,22 @@ static struct ion_heap_ops system_heap_ops = {
 	.shrink = ion_system_heap_shrink,
 };
 
+static unsigned long ion_system_heap_pool_stats_show(struct seq_file *s,
+						     const char *name,
+						     struct ion_page_pool *pool)
+{
+	struct ion_page_pool_stats stats;
+
+	ion_page_pool_get_stats(pool, &stats);
+	if (s && pool->mags)
+		seq_printf(s,
+			   "%lu order %u pages in %s pool magazines, %lu magazine hits %lu list hits %lu misses\n",
+			   stats.mag_count, pool->order, name, stats.mag_hits,
+			   stats.list_hits, stats.misses);
+
+	return (1 << pool->order) * PAGE_SIZE * stats.mag_count;
+}
+
 static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 				      void *unused)
 {
@@ -700,6 +744,8 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 			pool->high_count;
 		uncached_total += (1 << pool->order) * PAGE_SIZE *
 			pool->low_count;
+		uncached_total += ion_system_heap_pool_stats_show(s, "uncached",
+								pool);
 	}
 
 	for (i = 0; i < num_orders; i++) {
@@ -721,6 +767,8 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 			pool->high_count;
 		cached_total += (1 << pool->order) * PAGE_SIZE *
 			pool->low_count;
+		cached_total += ion_system_heap_pool_stats_show(s, "cached",
+								pool);
 	}
 
 	for (i = 0; i < num_orders; i++) {
@@ -746,6 +794,8 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 					 pool->high_count;
 			secure_total += (1 << pool->order) * PAGE_SIZE *
 					 pool->low_count;
+			secure_total += ion_system_heap_pool_stats_show(s,
+							"secure", pool);
 		}
 	}
 
@@ -768,6 +818,109 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 	return 0;
 }
 
+static bool ion_system_heap_pool_low(struct ion_page_pool *pool, int idx)
+{
+	unsigned int watermark = pool_watermark_kb[idx] >> (PAGE_SHIFT - 10);
+
+	return ion_page_pool_total(pool, true) < watermark;
+}
+
+static bool ion_system_heap_refill_paused(struct ion_system_heap *sys_heap)
+{
+	return time_before(jiffies, READ_ONCE(sys_heap->refill_resume));
+}
+
+/*
+ * Sleep until the back-off ends, so the pools refill without waiting for
+ * the next allocation to wake us.
+ */
+static long ion_system_heap_refill_timeout(struct ion_system_heap *sys_heap)
+{
+	long left = READ_ONCE(sys_heap->refill_resume) - jiffies;
+
+	return left > 0 ? left : MAX_SCHEDULE_TIMEOUT;
+}
+
+static bool ion_system_heap_needs_refill(struct ion_system_heap *sys_heap)
+{
+	int i;
+
+	if (ion_system_heap_refill_paused(sys_heap))
+		return false;
+
+	for (i = 0; i < num_orders; i++) {
+		if (ion_system_heap_pool_low(sys_heap->uncached_pools[i], i) ||
+		    ion_system_heap_pool_low(sys_heap->cached_pools[i], i))
+			return true;
+	}
+	return false;
+}
+
+static void ion_system_heap_refill(struct ion_system_heap *sys_heap)
+{
+	int i, j;
+
+	for (i = 0; i < num_orders; i++) {
+		struct ion_page_pool *pools[] = {
+			sys_heap->uncached_pools[i],
+			sys_heap->cached_pools[i],
+		};
+		/* Only take what is free, never reclaim to fill a pool */
+		gfp_t gfp_mask = (pools[0]->gfp_mask | __GFP_NORETRY |
+				  __GFP_NOWARN) & ~__GFP_RECLAIM;
+
+		for (j = 0; j < ARRAY_SIZE(pools); j++) {
+			while (ion_system_heap_pool_low(pools[j], i)) {
+				if (kthread_should_stop() ||
+				    ion_system_heap_refill_paused(sys_heap))
+					return;
+				if (ion_page_pool_refill(pools[j], gfp_mask)) {
+					WRITE_ONCE(sys_heap->refill_resume,
+						   jiffies +
+						   ION_POOL_REFILL_BACKOFF);
+					return;
+				}
+				cond_resched();
+			}
+		}
+	}
+}
+
+static int ion_system_heap_refill_thread(void *data)
+{
+	struct ion_system_heap *sys_heap = data;
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		wait_event_freezable_timeout(sys_heap->refill_wait,
+				ion_system_heap_needs_refill(sys_heap) ||
+				kthread_should_stop(),
+				ion_system_heap_refill_timeout(sys_heap));
+		ion_system_heap_refill(sys_heap);
+	}
+
+	return 0;
+}
+
+static void ion_system_heap_init_refill(struct ion_system_heap *sys_heap)
+{
+	struct sched_param param = { .sched_priority = 0 };
+
+	BUILD_BUG_ON(ARRAY_SIZE(pool_watermark_kb) != ARRAY_SIZE(orders));
+
+	init_waitqueue_head(&sys_heap->refill_wait);
+	sys_heap->refill_task = kthread_run(ion_system_heap_refill_thread,
+					    sys_heap, "ion_pool_refill");
+	if (IS_ERR(sys_heap->refill_task)) {
+		pr_err("%s: creating thread for pool refill failed\n",
+		       __func__);
+		sys_heap->refill_task = NULL;
+		return;
+	}
+	/* Zeroing is only worth doing when nothing else wants the cpu */
+	sched_setscheduler(sys_heap->refill_task, SCHED_IDLE, &param);
+}
+
 static void ion_system_heap_destroy_pools(struct ion_page_pool **pools)
 {
 	int i;
@@ -846,6 +999,7 @@ struct ion_heap *ion_system_heap_create(struct ion_platform_heap *data)
 		goto err_create_cached_pools;
 
 	mutex_init(&heap->split_page_mutex);
+	ion_system_heap_init_refill(heap);
 
 	heap->heap.debug_show = ion_system_heap_debug_show;
 	return &heap->heap;
@@ -875,6 +1029,9 @@ void ion_system_heap_destroy(struct ion_heap *heap)
 							heap);
 	int i, j;
 
+	if (sys_heap->refill_task)
+		kthread_stop(sys_heap->refill_task);
+
 	for (i = 0; i < VMID_LAST; i++) {
 		if (!is_secure_vmid_valid(i))
 			continue;
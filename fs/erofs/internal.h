@@ -107,8 +107,24 @@ struct erofs_sb_info {
 
 #ifdef EROFS_FS_HAS_MANAGED_CACHE
 	struct inode *managed_cache;
+
+	/* workgroups which may hold cached compressed pages, hottest first */
+	struct list_head mc_lru;
+	spinlock_t mc_lru_lock;
+	/* budget of the managed cache in pages, 0 for unlimited */
+	unsigned long mc_max_pages;
+
+	atomic_long_t mc_hits;
+	atomic_long_t mc_misses;
+	atomic_long_t mc_evictions;
 #endif
 
+	/* how decompressed data reached its output pages, for sysfs */
+	atomic_long_t unzip_plain;
+	atomic_long_t unzip_percpu;
+	atomic_long_t unzip_inplace;
+	atomic_long_t unzip_window;
+	atomic_long_t unzip_vmap;
 #endif
 
 	u32 build_time_nsec;
@@ -126,6 +142,10 @@ struct erofs_sb_info {
 	unsigned int mount_opt;
 	unsigned int shrinker_run_no;
 
+	/* /sys/fs/erofs/<disk> */
+	struct kobject s_kobj;
+	struct completion s_kobj_unregister;
+
 #ifdef CONFIG_EROFS_FAULT_INJECTION
 	struct erofs_fault_info fault_info;	/* For fault injection */
 #endif
@@ -175,6 +195,7 @@ static inline void *erofs_kmalloc(struct erofs_sb_info *sbi,
 #define EROFS_MOUNT_POSIX_ACL		0x00000020
 #define EROFS_MOUNT_FAULT_INJECTION	0x00000040
 #define EROFS_MOUNT_LZ4ASM		0x01000000
+#define EROFS_MOUNT_PARALLEL_UNZIP	0x02000000
 
 #define clear_opt(sbi, option)	((sbi)->mount_opt &= ~EROFS_MOUNT_##option)
 #define set_opt(sbi, option)	((sbi)->mount_opt |= EROFS_MOUNT_##option)
@@ -282,6 +303,9 @@ static inline struct address_space *MNGD_MAPPING(struct erofs_sb_info *sbi)
 	return sbi->managed_cache->i_mapping;
 }
 
+/* default budget of the per-superblock managed cache */
+#define EROFS_MC_DEFAULT_MAX_KB		(32 * 1024)
+
 extern int erofs_try_to_free_all_cached_pages(struct erofs_sb_info *sbi,
 	struct erofs_workgroup *egrp);
 extern int erofs_try_to_free_cached_page(struct address_space *mapping,
@@ -637,6 +661,12 @@ extern struct page *erofs_allocpage(struct list_head *pool, gfp_t gfp);
 extern void erofs_register_super(struct super_block *sb);
 extern void erofs_unregister_super(struct super_block *sb);
 
+/* sysfs.c */
+extern int erofs_register_sysfs(struct super_block *sb);
+extern void erofs_unregister_sysfs(struct super_block *sb);
+extern int __init erofs_init_sysfs(void);
+extern void erofs_exit_sysfs(void);
+
 extern unsigned long erofs_shrink_count(struct shrinker *shrink,
 	struct shrink_control *sc);
 extern unsigned long erofs_shrink_scan(struct shrinker *shrink,
@@ -187,6 +187,7 @@ static void default_options(struct erofs_sb_info *sbi)
 #endif
 
 	set_opt(sbi, LZ4ASM);
+	set_opt(sbi, PARALLEL_UNZIP);
 }
 
 static bool force_disable_erofs = false;
@@ -198,6 +199,8 @@ enum {
 	Opt_fault_injection,
 	Opt_lz4asm,
 	Opt_nolz4asm,
+	Opt_parallel_unzip,
+	Opt_noparallel_unzip,
 	Opt_fmount,
 	Opt_err
 };
@@ -210,6 +213,8 @@ static match_table_t erofs_tokens = {
 	{Opt_fault_injection, "fault_injection=%u"},
 	{Opt_lz4asm,	"lz4asm"},
 	{Opt_nolz4asm,	"nolz4asm"},
+	{Opt_parallel_unzip,	"parallel_unzip"},
+	{Opt_noparallel_unzip,	"noparallel_unzip"},
 	{Opt_fmount,	"fmount"},
 	{Opt_err, NULL}
 };
@@ -280,6 +285,12 @@ static int parse_options(struct super_block *sb, char *options)
 		case Opt_nolz4asm:
 			clear_opt(EROFS_SB(sb), LZ4ASM);
 			break;
+		case Opt_parallel_unzip:
+			set_opt(EROFS_SB(sb), PARALLEL_UNZIP);
+			break;
+		case Opt_noparallel_unzip:
+			clear_opt(EROFS_SB(sb), PARALLEL_UNZIP);
+			break;
 		case Opt_fmount:
 			force_panic_mount = true;
 			break;
@@ -430,6 +441,10 @@ static int erofs_read_super(struct super_block *sb,
 #endif
 
 #ifdef EROFS_FS_HAS_MANAGED_CACHE
+	INIT_LIST_HEAD(&sbi->mc_lru);
+	spin_lock_init(&sbi->mc_lru_lock);
+	sbi->mc_max_pages = EROFS_MC_DEFAULT_MAX_KB >> (PAGE_SHIFT - 10);
+
 	sbi->managed_cache = erofs_init_managed_cache(sb);
 	if (IS_ERR(sbi->managed_cache)) {
 		err = PTR_ERR(sbi->managed_cache);
@@ -467,6 +482,10 @@ static int erofs_read_super(struct super_block *sb,
 	snprintf(sbi->dev_name, PATH_MAX, "%s", dev_name);
 	sbi->dev_name[PATH_MAX - 1] = '\0';
 
+	err = erofs_register_sysfs(sb);
+	if (err)
+		goto err_sysfs;
+
 	erofs_register_super(sb);
 
 	/*
@@ -484,6 +503,8 @@ static int erofs_read_super(struct super_block *sb,
 	 * the following name convention, thus new features
 	 * can be integrated easily without renaming labels.
 	 */
+err_sysfs:
+	__putname(sbi->dev_name);
 err_devname:
 	dput(sb->s_root);
 err_makeroot:
@@ -520,6 +541,8 @@ static void erofs_put_super(struct super_block *sb)
 	infoln("unmounted for %s", sbi->dev_name);
 	__putname(sbi->dev_name);
 
+	erofs_unregister_sysfs(sb);
+
 #ifdef EROFS_FS_HAS_MANAGED_CACHE
 	iput(sbi->managed_cache);
 #endif
@@ -613,6 +636,10 @@ static int __init erofs_module_init(void)
 		goto zip_err;
 #endif
 
+	err = erofs_init_sysfs();
+	if (err)
+		goto sysfs_err;
+
 	err = register_filesystem(&erofs_fs_type);
 	if (err)
 		goto fs_err;
@@ -632,6 +659,8 @@ static int __init erofs_module_init(void)
 	return 0;
 
 fs_err:
+	erofs_exit_sysfs();
+sysfs_err:
 #ifdef CONFIG_EROFS_FS_ZIP
 	z_erofs_exit_zip_subsystem();
 zip_err:
@@ -646,6 +675,7 @@ static int __init erofs_module_init(void)
 static void __exit erofs_module_exit(void)
 {
 	unregister_filesystem(&erofs_fs_type);
+	erofs_exit_sysfs();
 #ifdef CONFIG_EROFS_FS_ZIP
 	z_erofs_exit_zip_subsystem();
 #endif
@@ -701,6 +731,12 @@ static int erofs_show_options(struct seq_file *seq, struct dentry *root)
 		seq_puts(seq, ",lz4asm");
 	else
 		seq_puts(seq, ",nolz4asm");
+#ifdef CONFIG_EROFS_FS_ZIP
+	if (test_opt(sbi, PARALLEL_UNZIP))
+		seq_puts(seq, ",parallel_unzip");
+	else
+		seq_puts(seq, ",noparallel_unzip");
+#endif
 
 	return 0;
 }
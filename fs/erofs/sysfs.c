@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * linux/fs/erofs/sysfs.c
+ *
+ * Per-filesystem statistics exported under /sys/fs/erofs/<disk>/
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file COPYING in the main directory of the Linux
+ * distribution for more details.
+ */
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/string.h>
+#include "internal.h"
+
+struct erofs_attr {
+	struct attribute attr;
+	ssize_t (*show)(struct erofs_attr *, struct erofs_sb_info *, char *);
+	ssize_t (*store)(struct erofs_attr *, struct erofs_sb_info *,
+			 const char *, size_t);
+	int offset;
+};
+
+static ssize_t erofs_stat_show(struct erofs_attr *a,
+			       struct erofs_sb_info *sbi, char *buf)
+{
+	atomic_long_t *stat = (atomic_long_t *)((char *)sbi + a->offset);
+
+	return sprintf(buf, "%ld\n", atomic_long_read(stat));
+}
+
+#define EROFS_STAT_ATTR(_name, _field)				\
+static struct erofs_attr erofs_attr_##_name = {			\
+	.attr = { .name = __stringify(_name), .mode = 0444 },	\
+	.show = erofs_stat_show,				\
+	.offset = offsetof(struct erofs_sb_info, _field),	\
+}
+
+#define EROFS_RW_ATTR(_name)					\
+static struct erofs_attr erofs_attr_##_name = {			\
+	.attr = { .name = __stringify(_name), .mode = 0644 },	\
+	.show = _name##_show,					\
+	.store = _name##_store,					\
+}
+
+#define EROFS_RO_ATTR(_name)					\
+static struct erofs_attr erofs_attr_##_name = {			\
+	.attr = { .name = __stringify(_name), .mode = 0444 },	\
+	.show = _name##_show,					\
+}
+
+#define ATTR_LIST(_name) (&erofs_attr_##_name.attr)
+
+#ifdef EROFS_FS_HAS_MANAGED_CACHE
+static ssize_t mc_pages_show(struct erofs_attr *a,
+			     struct erofs_sb_info *sbi, char *buf)
+{
+	return sprintf(buf, "%lu\n", MNGD_MAPPING(sbi)->nrpages);
+}
+
+static ssize_t managed_cache_kb_show(struct erofs_attr *a,
+				     struct erofs_sb_info *sbi, char *buf)
+{
+	return sprintf(buf, "%lu\n",
+		       READ_ONCE(sbi->mc_max_pages) << (PAGE_SHIFT - 10));
+}
+
+static ssize_t managed_cache_kb_store(struct erofs_attr *a,
+				      struct erofs_sb_info *sbi,
+				      const char *buf, size_t len)
+{
+	unsigned long kb;
+	int ret;
+
+	ret = kstrtoul(skip_spaces(buf), 0, &kb);
+	if (ret < 0)
+		return ret;
+
+	/* shrinking takes effect as the next reads trim the cache */
+	WRITE_ONCE(sbi->mc_max_pages, kb >> (PAGE_SHIFT - 10));
+	return len;
+}
+
+EROFS_RO_ATTR(mc_pages);
+EROFS_RW_ATTR(managed_cache_kb);
+EROFS_STAT_ATTR(mc_hits, mc_hits);
+EROFS_STAT_ATTR(mc_misses, mc_misses);
+EROFS_STAT_ATTR(mc_evictions, mc_evictions);
+#endif
+
+#ifdef CONFIG_EROFS_FS_ZIP
+EROFS_STAT_ATTR(unzip_plain, unzip_plain);
+EROFS_STAT_ATTR(unzip_percpu, unzip_percpu);
+EROFS_STAT_ATTR(unzip_inplace, unzip_inplace);
+EROFS_STAT_ATTR(unzip_window, unzip_window);
+EROFS_STAT_ATTR(unzip_vmap, unzip_vmap);
+#endif
+
+static struct attribute *erofs_attrs[] = {
+#ifdef CONFIG_EROFS_FS_ZIP
+	ATTR_LIST(unzip_plain),
+	ATTR_LIST(unzip_percpu),
+	ATTR_LIST(unzip_inplace),
+	ATTR_LIST(unzip_window),
+	ATTR_LIST(unzip_vmap),
+#endif
+#ifdef EROFS_FS_HAS_MANAGED_CACHE
+	ATTR_LIST(managed_cache_kb),
+	ATTR_LIST(mc_pages),
+	ATTR_LIST(mc_hits),
+	ATTR_LIST(mc_misses),
+	ATTR_LIST(mc_evictions),
+#endif
+	NULL,
+};
+
+static ssize_t erofs_attr_show(struct kobject *kobj,
+			       struct attribute *attr, char *buf)
+{
+	struct erofs_sb_info *sbi = container_of(kobj, struct erofs_sb_info,
+						 s_kobj);
+	struct erofs_attr *a = container_of(attr, struct erofs_attr, attr);
+
+	return a->show ? a->show(a, sbi, buf) : 0;
+}
+
+static ssize_t erofs_attr_store(struct kobject *kobj, struct attribute *attr,
+				const char *buf, size_t len)
+{
+	struct erofs_sb_info *sbi = container_of(kobj, struct erofs_sb_info,
+						 s_kobj);
+	struct erofs_attr *a = container_of(attr, struct erofs_attr, attr);
+
+	return a->store ? a->store(a, sbi, buf, len) : 0;
+}
+
+static const struct sysfs_ops erofs_attr_ops = {
+	.show	= erofs_attr_show,
+	.store	= erofs_attr_store,
+};
+
+static void erofs_sb_release(struct kobject *kobj)
+{
+	struct erofs_sb_info *sbi = container_of(kobj, struct erofs_sb_info,
+						 s_kobj);
+
+	complete(&sbi->s_kobj_unregister);
+}
+
+static struct kobj_type erofs_sb_ktype = {
+	.default_attrs	= erofs_attrs,
+	.sysfs_ops	= &erofs_attr_ops,
+	.release	= erofs_sb_release,
+};
+
+static struct kobj_type erofs_ktype = {
+	.sysfs_ops	= &erofs_attr_ops,
+};
+
+static struct kset erofs_kset = {
+	.kobj	= {.ktype = &erofs_ktype},
+};
+
+int erofs_register_sysfs(struct super_block *sb)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+	int err;
+
+	sbi->s_kobj.kset = &erofs_kset;
+	init_completion(&sbi->s_kobj_unregister);
+	err = kobject_init_and_add(&sbi->s_kobj, &erofs_sb_ktype, NULL,
+				   "%s", sb->s_id);
+	if (err) {
+		kobject_put(&sbi->s_kobj);
+		wait_for_completion(&sbi->s_kobj_unregister);
+	}
+	return err;
+}
+
+void erofs_unregister_sysfs(struct super_block *sb)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+
+	kobject_del(&sbi->s_kobj);
+	kobject_put(&sbi->s_kobj);
+	wait_for_completion(&sbi->s_kobj_unregister);
+}
+
+int __init erofs_init_sysfs(void)
+{
+	kobject_set_name(&erofs_kset.kobj, "erofs");
+	erofs_kset.kobj.parent = fs_kobj;
+	return kset_register(&erofs_kset);
+}
+
+void erofs_exit_sysfs(void)
+{
+	kset_unregister(&erofs_kset);
+}
@@ -7,7 +7,7 @@
  * Created by Gao Xiang <gaoxiang25@huawei.com>
  */
 #include "generic/lz4.h"
-#include "lz4armv8/lz4accel.h"
+#include <linux/lz4accel.h>
 
 #define LZ4_FAST_MARGIN                (128)
 
@@ -12,6 +12,7 @@
  */
 #include "unzip_vle.h"
 #include <linux/prefetch.h>
+#include <linux/backing-dev.h>
 #include <linux/migrate.h>
 
 #include <trace/events/erofs.h>
@@ -28,6 +29,7 @@ void z_erofs_exit_zip_subsystem(void)
 
 	destroy_workqueue(z_erofs_workqueue);
 	kmem_cache_destroy(z_erofs_workgroup_cachep);
+	z_erofs_vle_exit_windows();
 }
 
 static inline int init_unzip_workqueue(void)
@@ -53,8 +55,10 @@ int z_erofs_init_zip_subsystem(void)
 		SLAB_RECLAIM_ACCOUNT, NULL);
 
 	if (z_erofs_workgroup_cachep != NULL) {
-		if (!init_unzip_workqueue())
+		if (!init_unzip_workqueue()) {
+			z_erofs_vle_init_windows();
 			return 0;
+		}
 
 		kmem_cache_destroy(z_erofs_workgroup_cachep);
 	}
@@ -245,9 +249,91 @@ int erofs_try_to_free_all_cached_pages(struct erofs_sb_info *sbi,
 		put_page(page);
 	}
 	mutex_unlock(&primary_work->lock);
+
+	spin_lock(&sbi->mc_lru_lock);
+	list_del_init(&grp->mc_lru);
+	spin_unlock(&sbi->mc_lru_lock);
 	return 0;
 }
 
+/*
+ * Note that @grp is being read by @inode. Clusters read by more than one
+ * file (shared libraries, dex in several apks) get extra passes on the
+ * lru before their compressed pages are dropped.
+ */
+static void z_erofs_vle_mc_touch(struct erofs_sb_info *sbi,
+				 struct z_erofs_vle_workgroup *grp,
+				 struct inode *inode)
+{
+	unsigned long last_ino = READ_ONCE(grp->mc_last_ino);
+
+	if (last_ino != inode->i_ino) {
+		if (last_ino)
+			WRITE_ONCE(grp->mc_shared, Z_EROFS_MC_SHARED_PASSES);
+		WRITE_ONCE(grp->mc_last_ino, inode->i_ino);
+	}
+
+	/* the common case, already on the lru: just mark it as used */
+	if (!list_empty(&grp->mc_lru)) {
+		WRITE_ONCE(grp->mc_referenced, true);
+		return;
+	}
+
+	spin_lock(&sbi->mc_lru_lock);
+	if (list_empty(&grp->mc_lru))
+		list_add(&grp->mc_lru, &sbi->mc_lru);
+	spin_unlock(&sbi->mc_lru_lock);
+}
+
+/*
+ * Drop cached compressed pages of idle workgroups until the managed
+ * cache fits its budget again. The lru is scanned clock-wise from its
+ * tail: recently used or shared workgroups are rotated instead.
+ */
+static void z_erofs_vle_mc_trim(struct erofs_sb_info *sbi)
+{
+	struct address_space *const mc = MNGD_MAPPING(sbi);
+	unsigned long max_pages = READ_ONCE(sbi->mc_max_pages);
+	unsigned int nr_scan = Z_EROFS_MC_TRIM_BATCH;
+	struct z_erofs_vle_workgroup *grp;
+
+	while (max_pages && mc->nrpages > max_pages && nr_scan--) {
+		spin_lock(&sbi->mc_lru_lock);
+		if (list_empty(&sbi->mc_lru)) {
+			spin_unlock(&sbi->mc_lru_lock);
+			break;
+		}
+
+		grp = list_last_entry(&sbi->mc_lru,
+			struct z_erofs_vle_workgroup, mc_lru);
+
+		if (grp->mc_referenced || grp->mc_shared) {
+			if (grp->mc_referenced)
+				grp->mc_referenced = false;
+			else
+				--grp->mc_shared;
+rotate:
+			list_move(&grp->mc_lru, &sbi->mc_lru);
+			spin_unlock(&sbi->mc_lru_lock);
+			continue;
+		}
+
+		/* only the workstation holds it, nobody is decompressing */
+		if (!erofs_workgroup_try_to_freeze(&grp->obj, 1))
+			goto rotate;
+		spin_unlock(&sbi->mc_lru_lock);
+
+		if (erofs_try_to_free_all_cached_pages(sbi, &grp->obj)) {
+			spin_lock(&sbi->mc_lru_lock);
+			list_move(&grp->mc_lru, &sbi->mc_lru);
+			spin_unlock(&sbi->mc_lru_lock);
+		} else {
+			atomic_long_inc(&sbi->mc_evictions);
+		}
+		erofs_workgroup_unfreeze(&grp->obj, 1);
+	}
+}
+
 int erofs_try_to_free_cached_page(struct address_space *mapping,
 				  struct page *page)
 {
@@ -542,6 +628,9 @@ z_erofs_vle_work_register(const struct z_erofs_vle_work_finder *f,
 
 	grp->obj.index = f->idx;
 	grp->llen = map->m_llen;
+#ifdef EROFS_FS_HAS_MANAGED_CACHE
+	INIT_LIST_HEAD(&grp->mc_lru);
+#endif
 
 	z_erofs_vle_set_workgrp_fmt(grp,
 		(map->m_flags & EROFS_MAP_ZIPPED) ?
@@ -811,6 +900,7 @@ static int z_erofs_do_read_page(struct z_erofs_vle_frontend *fe,
 		/* compressed page caching selection strategy */
 		fe->initial | (EROFS_FS_ZIP_CACHE_LVL >= 2 ?
 			       map->m_la < fe->cachedzone_la : 0), page_pool);
+	z_erofs_vle_mc_touch(sbi, builder->grp, fe->inode);
 #endif
 
 	tight &= builder_is_weak_followed(builder);
@@ -967,8 +1057,26 @@ static inline void z_erofs_vle_read_endio(struct bio *bio)
 	bio_put(bio);
 }
 
-static struct page *z_pagemap_global[Z_EROFS_VLE_VMAP_GLOBAL_PAGES];
-static DEFINE_MUTEX(z_pagemap_global_lock);
+/*
+ * If all output pages are physically contiguous lowmem pages, the linear
+ * mapping already covers them and they can be decompressed into directly.
+ */
+static void *z_erofs_vle_contig_vaddr(struct page **pages, unsigned nr_pages)
+{
+	unsigned long pfn;
+	unsigned i;
+
+	if (pages[0] == NULL)
+		return NULL;
+
+	pfn = page_to_pfn(pages[0]);
+	for (i = 0; i < nr_pages; ++i) {
+		if (pages[i] == NULL || PageHighMem(pages[i]) ||
+		    page_to_pfn(pages[i]) != pfn + i)
+			return NULL;
+	}
+	return page_address(pages[0]);
+}
 
 static int z_erofs_vle_unzip(struct super_block *sb,
 	struct z_erofs_vle_workgroup *grp,
@@ -1002,22 +1110,14 @@ static int z_erofs_vle_unzip(struct super_block *sb,
 
 	if (likely(nr_pages <= Z_EROFS_VLE_VMAP_ONSTACK_PAGES))
 		pages = pages_onstack;
-	else if (nr_pages <= Z_EROFS_VLE_VMAP_GLOBAL_PAGES &&
-		mutex_trylock(&z_pagemap_global_lock))
-		pages = z_pagemap_global;
 	else {
 repeat:
 		pages = kvmalloc_array(nr_pages,
 			sizeof(struct page *), GFP_KERNEL);
 
-		/* fallback to global pagemap for the lowmem scenario */
 		if (unlikely(pages == NULL)) {
-			if (nr_pages > Z_EROFS_VLE_VMAP_GLOBAL_PAGES)
-				goto repeat;
-			else {
-				mutex_lock(&z_pagemap_global_lock);
-				pages = z_pagemap_global;
-			}
+			congestion_wait(BLK_RW_ASYNC, HZ / 50);
+			goto repeat;
 		}
 	}
 
@@ -1101,6 +1201,7 @@ static int z_erofs_vle_unzip(struct super_block *sb,
 
 		err = z_erofs_vle_plain_copy(compressed_pages, clusterpages,
 			pages, nr_pages, work->pageofs);
+		atomic_long_inc(&sbi->unzip_plain);
 		goto out;
 	}
 
@@ -1110,8 +1211,29 @@ static int z_erofs_vle_unzip(struct super_block *sb,
 	err = z_erofs_vle_unzip_fast_percpu(compressed_pages,
 		clusterpages, pages, llen, work->pageofs,
 		test_opt(sbi, LZ4ASM));
-	if (err != -ENOTSUPP)
+	if (err != -ENOTSUPP) {
+		atomic_long_inc(&sbi->unzip_percpu);
+		goto out;
+	}
+
+	if (sparsemem_pages >= nr_pages) {
+		vout = z_erofs_vle_contig_vaddr(pages, nr_pages);
+		if (vout != NULL) {
+			err = z_erofs_vle_unzip_vmap(compressed_pages,
+				clusterpages, vout, llen, work->pageofs,
+				overlapped, test_opt(sbi, LZ4ASM));
+			atomic_long_inc(&sbi->unzip_inplace);
+			goto out;
+		}
+	}
+
+	err = z_erofs_vle_unzip_window(compressed_pages,
+		clusterpages, pages, llen, work->pageofs,
+		test_opt(sbi, LZ4ASM));
+	if (err != -ENOTSUPP) {
+		atomic_long_inc(&sbi->unzip_window);
 		goto out;
+	}
 
 	if (sparsemem_pages >= nr_pages) {
 		BUG_ON(sparsemem_pages > nr_pages);
@@ -1141,6 +1263,7 @@ static int z_erofs_vle_unzip(struct super_block *sb,
 		work->pageofs, overlapped, test_opt(sbi, LZ4ASM));
 
 	erofs_vunmap(vout, nr_pages);
+	atomic_long_inc(&sbi->unzip_vmap);
 
 out:
 	/* must handle all compressed pages before endding pages */
@@ -1175,9 +1298,7 @@ static int z_erofs_vle_unzip(struct super_block *sb,
 		z_erofs_onlinepage_endio(page);
 	}
 
-	if (pages == z_pagemap_global)
-		mutex_unlock(&z_pagemap_global_lock);
-	else if (unlikely(pages != pages_onstack))
+	if (unlikely(pages != pages_onstack))
 		kvfree(pages);
 
 	work->nr_pages = 0;
@@ -1216,6 +1337,63 @@ static void z_erofs_vle_unzip_all(struct super_block *sb,
 	}
 }
 
+struct z_erofs_vle_unzip_task {
+	struct work_struct work;
+	struct super_block *sb;
+	struct z_erofs_vle_workgroup *grp;
+};
+
+static void z_erofs_vle_unzip_task_wq(struct work_struct *work)
+{
+	struct z_erofs_vle_unzip_task *task = container_of(work,
+		struct z_erofs_vle_unzip_task, work);
+	LIST_HEAD(page_pool);
+
+	z_erofs_vle_unzip(task->sb, task->grp, &page_pool);
+
+	put_pages_list(&page_pool);
+	kfree(task);
+}
+
+/*
+ * Workgroups of one io are independent of each other, so hand all but
+ * the last one out as separate work items and let other cpus pick them
+ * up. If a work item can't be allocated, that workgroup is simply
+ * decompressed here as before.
+ */
+static void z_erofs_vle_unzip_fanout(struct super_block *sb,
+				     struct z_erofs_vle_unzip_io *io,
+				     struct list_head *page_pool)
+{
+	z_erofs_vle_owned_workgrp_t owned = io->head;
+
+	while (owned != Z_EROFS_VLE_WORKGRP_TAIL_CLOSED) {
+		struct z_erofs_vle_unzip_task *task;
+		struct z_erofs_vle_workgroup *grp;
+
+		DBG_BUGON(owned == Z_EROFS_VLE_WORKGRP_TAIL);
+		DBG_BUGON(owned == Z_EROFS_VLE_WORKGRP_NIL);
+
+		grp = owned;
+		/* grp->next is reset once grp is decompressed, read it first */
+		owned = READ_ONCE(grp->next);
+
+		if (owned != Z_EROFS_VLE_WORKGRP_TAIL_CLOSED) {
+			task = kmalloc(sizeof(*task), GFP_NOFS | __GFP_NOWARN);
+			if (task != NULL) {
+				INIT_WORK(&task->work,
+					  z_erofs_vle_unzip_task_wq);
+				task->sb = sb;
+				task->grp = grp;
+				queue_work(z_erofs_workqueue, &task->work);
+				continue;
+			}
+		}
+
+		z_erofs_vle_unzip(sb, grp, page_pool);
+	}
+}
+
 static void z_erofs_vle_unzip_wq(struct work_struct *work)
 {
 	struct z_erofs_vle_unzip_io_sb *iosb = container_of(work,
@@ -1223,7 +1401,10 @@ static void z_erofs_vle_unzip_wq(struct work_struct *work)
 	LIST_HEAD(page_pool);
 
 	BUG_ON(iosb->io.head == Z_EROFS_VLE_WORKGRP_TAIL_CLOSED);
-	z_erofs_vle_unzip_all(iosb->sb, &iosb->io, &page_pool);
+	if (test_opt(EROFS_SB(iosb->sb), PARALLEL_UNZIP))
+		z_erofs_vle_unzip_fanout(iosb->sb, &iosb->io, &page_pool);
+	else
+		z_erofs_vle_unzip_all(iosb->sb, &iosb->io, &page_pool);
 
 	put_pages_list(&page_pool);
 	kvfree(iosb);
@@ -1439,6 +1620,7 @@ static bool z_erofs_vle_submit_all(struct super_block *sb,
 	pgoff_t uninitialized_var(last_index);
 	bool force_submit = false;
 	unsigned nr_bios;
+	unsigned long nr_cached = 0, nr_read = 0;
 
 	if (unlikely(owned_head == Z_EROFS_VLE_WORKGRP_TAIL))
 		return false;
@@ -1495,8 +1677,10 @@ static bool z_erofs_vle_submit_all(struct super_block *sb,
 		if (page == NULL) {
 			force_submit = true;
 			++noio;
+			++nr_cached;
 			goto skippage;
 		}
+		++nr_read;
 
 		if (bio != NULL && force_submit) {
 submit_bio_retry:
@@ -1555,6 +1739,10 @@ static bool z_erofs_vle_submit_all(struct super_block *sb,
 #ifndef EROFS_FS_HAS_MANAGED_CACHE
 	BUG_ON(!nr_bios);
 #else
+	atomic_long_add(nr_cached, &sbi->mc_hits);
+	atomic_long_add(nr_read, &sbi->mc_misses);
+	z_erofs_vle_mc_trim(sbi);
+
 	if (lstgrp_noio != NULL)
 		WRITE_ONCE(lstgrp_noio->next, Z_EROFS_VLE_WORKGRP_TAIL_CLOSED);
 
@@ -88,8 +88,23 @@ struct z_erofs_vle_workgroup {
 	/* compressed pages (including multi-usage pages) */
 	struct page *compressed_pages[Z_EROFS_CLUSTER_MAX_PAGES];
 	unsigned int llen, flags;
+
+#ifdef EROFS_FS_HAS_MANAGED_CACHE
+	/* on the managed cache lru, protected by sbi->mc_lru_lock */
+	struct list_head mc_lru;
+	/* the last file read through this cluster, to spot shared ones */
+	unsigned long mc_last_ino;
+	/* extra lru passes granted since more than one file uses it */
+	unsigned int mc_shared;
+	bool mc_referenced;
+#endif
 };
 
+/* how many extra lru passes a cluster shared by several files gets */
+#define Z_EROFS_MC_SHARED_PASSES	2
+/* lru entries looked at per trim, to bound the work done by one reader */
+#define Z_EROFS_MC_TRIM_BATCH		128
+
 /* let's avoid the valid 32-bit kernel addresses */
 
 /* the chained workgroup has't submitted io (still open) */
@@ -228,7 +243,9 @@ static inline void z_erofs_onlinepage_endio(struct page *page)
 
 #define Z_EROFS_VLE_VMAP_ONSTACK_PAGES	\
 	min_t(unsigned int, THREAD_SIZE / 8 / sizeof(struct page *), 96U)
-#define Z_EROFS_VLE_VMAP_GLOBAL_PAGES	2048
+
+/* per-cpu decompression windows, larger outputs still go through vmap */
+#define Z_EROFS_VLE_WINDOW_PAGES	32
 
 /* unzip_vle_lz4.c */
 extern int z_erofs_vle_plain_copy(struct page **compressed_pages,
@@ -239,6 +256,13 @@ extern int z_erofs_vle_unzip_fast_percpu(struct page **compressed_pages,
 	unsigned clusterpages, struct page **pages,
 	unsigned outlen, unsigned short pageofs, bool accel);
 
+extern int z_erofs_vle_unzip_window(struct page **compressed_pages,
+	unsigned clusterpages, struct page **pages,
+	unsigned outlen, unsigned short pageofs, bool accel);
+
+extern void z_erofs_vle_init_windows(void);
+extern void z_erofs_vle_exit_windows(void);
+
 extern int z_erofs_vle_unzip_vmap(struct page **compressed_pages,
 	unsigned clusterpages, void *vaddr, unsigned llen,
 	unsigned short pageofs, bool overlapped, bool accel);
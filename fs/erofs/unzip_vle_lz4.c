@@ -174,6 +174,126 @@ int z_erofs_vle_unzip_fast_percpu(struct page **compressed_pages,
 	return ret;
 }
 
+/*
+ * Per-cpu decompression windows: permanently mapped buffers which large
+ * outputs are decompressed into and then copied to their page cache
+ * pages. Multi-page clusters are copied into the window's input area
+ * first, so neither side needs a vmap()/vunmap() with its TLB flush.
+ * A window is protected by a mutex rather than by disabling preemption
+ * since decompressing this much can take a while.
+ */
+#define Z_EROFS_VLE_WINDOW_SIZE \
+	((Z_EROFS_VLE_WINDOW_PAGES + Z_EROFS_CLUSTER_MAX_PAGES) * PAGE_SIZE)
+
+struct z_erofs_vle_unzip_window {
+	struct mutex lock;
+	void *data;	/* Z_EROFS_VLE_WINDOW_PAGES of output */
+	void *in;	/* followed by a cluster of input */
+};
+
+static DEFINE_PER_CPU(struct z_erofs_vle_unzip_window, z_erofs_unzip_windows);
+
+int z_erofs_vle_unzip_window(struct page **compressed_pages,
+			     unsigned clusterpages,
+			     struct page **pages,
+			     unsigned outlen,
+			     unsigned short pageofs,
+			     bool accel)
+{
+	struct z_erofs_vle_unzip_window *win;
+	void *vin, *vout;
+	unsigned nr_pages, i, j;
+	int ret;
+
+	if (outlen + pageofs > Z_EROFS_VLE_WINDOW_PAGES * PAGE_SIZE)
+		return -ENOTSUPP;
+
+	win = raw_cpu_ptr(&z_erofs_unzip_windows);
+	if (win->data == NULL)
+		return -ENOTSUPP;
+
+	nr_pages = DIV_ROUND_UP(outlen + pageofs, PAGE_SIZE);
+
+	mutex_lock(&win->lock);
+	vout = win->data;
+
+	if (clusterpages == 1) {
+		vin = kmap(compressed_pages[0]);
+	} else {
+		vin = win->in;
+		for (i = 0; i < clusterpages; ++i) {
+			void *t = kmap_atomic(compressed_pages[i]);
+
+			memcpy(vin + i * PAGE_SIZE, t, PAGE_SIZE);
+			kunmap_atomic(t);
+		}
+	}
+
+	/*
+	 * The output only lands in its pages after decompression finished,
+	 * so compressed pages reused in-place don't need to be copied out.
+	 */
+	ret = z_erofs_unzip_lz4(vin, vout + pageofs,
+		clusterpages * PAGE_SIZE, outlen, accel);
+	if (ret < 0)
+		goto out;
+
+	ret = 0;
+
+	for (i = 0; i < nr_pages; ++i) {
+		j = min((unsigned)PAGE_SIZE - pageofs, outlen);
+
+		if (pages[i]) {
+			void *dst = kmap_atomic(pages[i]);
+
+			memcpy(dst + pageofs, vout + pageofs, j);
+			kunmap_atomic(dst);
+		}
+		vout += PAGE_SIZE;
+		outlen -= j;
+		pageofs = 0;
+	}
+
+out:
+	if (clusterpages == 1)
+		kunmap(compressed_pages[0]);
+
+	mutex_unlock(&win->lock);
+	return ret;
+}
+
+void z_erofs_vle_init_windows(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct z_erofs_vle_unzip_window *win =
+			per_cpu_ptr(&z_erofs_unzip_windows, cpu);
+
+		mutex_init(&win->lock);
+		/* not fatal, that cpu just keeps using vmap */
+		win->data = vmalloc_node(Z_EROFS_VLE_WINDOW_SIZE,
+					 cpu_to_node(cpu));
+		if (win->data)
+			win->in = win->data +
+				Z_EROFS_VLE_WINDOW_PAGES * PAGE_SIZE;
+	}
+}
+
+void z_erofs_vle_exit_windows(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct z_erofs_vle_unzip_window *win =
+			per_cpu_ptr(&z_erofs_unzip_windows, cpu);
+
+		vfree(win->data);
+		win->data = NULL;
+		win->in = NULL;
+	}
+}
+
 int z_erofs_vle_unzip_vmap(struct page **compressed_pages,
 			   unsigned clusterpages,
 			   void *vout,
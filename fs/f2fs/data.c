@@ -1520,6 +1520,13 @@ int f2fs_map_blocks(struct inode *inode, struct f2fs_map_blocks *map,
 				start_pgofs, map->m_pblk + ofs,
 				map->m_len - ofs);
 		}
+	} else if (!create && flag == F2FS_GET_BLOCK_DEFAULT) {
+		if (map->m_flags & F2FS_MAP_MAPPED) {
+			unsigned int ofs = start_pgofs - map->m_lblk;
+
+			f2fs_cache_read_extent(&dn, start_pgofs,
+				map->m_pblk + ofs, map->m_len - ofs);
+		}
 	}
 
 	f2fs_put_dnode(&dn);
@@ -1547,6 +1554,13 @@ int f2fs_map_blocks(struct inode *inode, struct f2fs_map_blocks *map,
 		}
 		if (map->m_next_extent)
 			*map->m_next_extent = pgofs + 1;
+	} else if (!create && flag == F2FS_GET_BLOCK_DEFAULT) {
+		if (map->m_flags & F2FS_MAP_MAPPED) {
+			unsigned int ofs = start_pgofs - map->m_lblk;
+
+			f2fs_cache_read_extent(&dn, start_pgofs,
+				map->m_pblk + ofs, map->m_len - ofs);
+		}
 	}
 	f2fs_put_dnode(&dn);
 unlock_out:
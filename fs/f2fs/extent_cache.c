@@ -203,6 +203,7 @@ static struct extent_node *__attach_extent_node(struct f2fs_sb_info *sbi,
 	en->ei = *ei;
 	INIT_LIST_HEAD(&en->list);
 	en->et = et;
+	en->age = jiffies;
 
 	rb_link_node(&en->rb_node, parent, p);
 	rb_insert_color(&en->rb_node, &et->root);
@@ -399,12 +400,15 @@ static bool f2fs_lookup_extent_tree(struct inode *inode, pgoff_t pgofs,
 	spin_lock(&sbi->extent_lock);
 	if (!list_empty(&en->list)) {
 		list_move_tail(&en->list, &sbi->extent_list);
+		en->age = jiffies;
 		et->cached_en = en;
 	}
 	spin_unlock(&sbi->extent_lock);
 	ret = true;
 out:
 	stat_inc_total_hit(sbi);
+	percpu_counter_inc(ret ? &sbi->extent_cache_hit :
+				 &sbi->extent_cache_miss);
 	read_unlock(&et->lock);
 
 	trace_f2fs_lookup_extent_tree_end(inode, pgofs, ei);
@@ -442,6 +446,7 @@ static struct extent_node *__try_merge_extent_node(struct f2fs_sb_info *sbi,
 	spin_lock(&sbi->extent_lock);
 	if (!list_empty(&en->list)) {
 		list_move_tail(&en->list, &sbi->extent_list);
+		en->age = jiffies;
 		et->cached_en = en;
 	}
 	spin_unlock(&sbi->extent_lock);
@@ -688,6 +693,54 @@ unsigned int f2fs_shrink_extent_tree(struct f2fs_sb_info *sbi, int nr_shrink)
 	return node_cnt + tree_cnt;
 }
 
+/*
+ * Drop extent nodes which haven't been used for extent_cache_age seconds.
+ * The LRU list is kept in order of last use, so stop at the first young
+ * node, or at a busy tree rather than reordering the list.
+ */
+unsigned int f2fs_shrink_aged_extent_nodes(struct f2fs_sb_info *sbi,
+						int nr_shrink)
+{
+	struct extent_tree *et;
+	struct extent_node *en;
+	unsigned int node_cnt = 0;
+	unsigned long expires;
+
+	if (!test_opt(sbi, EXTENT_CACHE) || !sbi->extent_cache_age)
+		return 0;
+
+	if (!mutex_trylock(&sbi->extent_tree_lock))
+		return 0;
+
+	expires = jiffies - sbi->extent_cache_age * HZ;
+
+	spin_lock(&sbi->extent_lock);
+	while (node_cnt < nr_shrink && !list_empty(&sbi->extent_list)) {
+		en = list_first_entry(&sbi->extent_list,
+					struct extent_node, list);
+		if (time_after(en->age, expires))
+			break;
+		et = en->et;
+		if (!write_trylock(&et->lock))
+			break;
+
+		list_del_init(&en->list);
+		spin_unlock(&sbi->extent_lock);
+
+		__detach_extent_node(sbi, et, en);
+
+		write_unlock(&et->lock);
+		node_cnt++;
+		spin_lock(&sbi->extent_lock);
+	}
+	spin_unlock(&sbi->extent_lock);
+
+	mutex_unlock(&sbi->extent_tree_lock);
+
+	trace_f2fs_shrink_extent_tree(sbi, node_cnt, 0);
+	return node_cnt;
+}
+
 unsigned int f2fs_destroy_extent_node(struct inode *inode)
 {
 	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
@@ -796,6 +849,58 @@ void f2fs_update_extent_cache_range(struct dnode_of_data *dn,
 	f2fs_update_extent_tree_range(dn->inode, fofs, blkaddr, len);
 }
 
+/*
+ * Cache a mapping f2fs_map_blocks() had to read from a dnode, so that the
+ * next lookup of a fragmented file doesn't need the node page again.  This
+ * only fills the gap in front of the next cached extent: the mapping is
+ * already known to the tree beyond that.  Reads may grow the cache up to
+ * extent_cache_budget nodes, evicting from the LRU head past that.
+ * The caller holds the dnode locked, so the blocks can't move under us.
+ */
+void f2fs_cache_read_extent(struct dnode_of_data *dn,
+				pgoff_t fofs, block_t blkaddr, unsigned int len)
+{
+	struct inode *inode = dn->inode;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct extent_tree *et = F2FS_I(inode)->extent_tree;
+	struct extent_node *en, *prev_en, *next_en;
+	struct rb_node **insert_p, *insert_parent;
+	struct extent_info ei;
+	unsigned int budget = READ_ONCE(sbi->extent_cache_budget);
+	int over;
+
+	if (!et || !budget || !len)
+		return;
+
+	over = atomic_read(&sbi->total_ext_node) - budget + 1;
+	if (over > 0)
+		f2fs_shrink_extent_tree(sbi,
+				max_t(int, over, EXTENT_CACHE_SHRINK_NUMBER));
+
+	write_lock(&et->lock);
+
+	if (is_inode_flag_set(inode, FI_NO_EXTENT))
+		goto out;
+
+	en = (struct extent_node *)f2fs_lookup_rb_tree_ret(&et->root,
+					(struct rb_entry *)et->cached_en, fofs,
+					(struct rb_entry **)&prev_en,
+					(struct rb_entry **)&next_en,
+					&insert_p, &insert_parent, false);
+	/* another reader got here first */
+	if (en)
+		goto out;
+
+	if (next_en && next_en->ei.fofs < fofs + len)
+		len = next_en->ei.fofs - fofs;
+
+	set_extent_info(&ei, fofs, blkaddr, len);
+	if (!__try_merge_extent_node(sbi, et, &ei, prev_en, next_en))
+		__insert_extent_tree(sbi, et, &ei, insert_p, insert_parent);
+out:
+	write_unlock(&et->lock);
+}
+
 void f2fs_init_extent_cache_info(struct f2fs_sb_info *sbi)
 {
 	INIT_RADIX_TREE(&sbi->extent_tree_root, GFP_NOIO);
@@ -806,6 +911,8 @@ void f2fs_init_extent_cache_info(struct f2fs_sb_info *sbi)
 	INIT_LIST_HEAD(&sbi->zombie_list);
 	atomic_set(&sbi->total_zombie_tree, 0);
 	atomic_set(&sbi->total_ext_node, 0);
+	sbi->extent_cache_budget = DEF_EXTENT_CACHE_BUDGET;
+	sbi->extent_cache_age = DEF_EXTENT_CACHE_AGE;
 }
 
 int __init f2fs_create_extent_cache(void)
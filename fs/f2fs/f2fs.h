@@ -558,6 +558,11 @@ enum {
 /* number of extent info in extent cache we try to shrink */
 #define EXTENT_CACHE_SHRINK_NUMBER	128
 
+/* extent nodes per superblock that reads may add, 0 to disable */
+#define DEF_EXTENT_CACHE_BUDGET		8192
+/* seconds after which an unused extent node is shrunk first */
+#define DEF_EXTENT_CACHE_AGE		300
+
 struct rb_entry {
 	struct rb_node rb_node;		/* rb node located in rb-tree */
 	unsigned int ofs;		/* start offset of the entry */
@@ -575,6 +580,7 @@ struct extent_node {
 	struct extent_info ei;		/* extent info */
 	struct list_head list;		/* node in global extent list of sbi */
 	struct extent_tree *et;		/* extent tree pointer */
+	unsigned long age;		/* jiffies when last used */
 };
 
 struct extent_tree {
@@ -1271,6 +1277,10 @@ struct f2fs_sb_info {
 	struct list_head zombie_list;		/* extent zombie tree list */
 	atomic_t total_zombie_tree;		/* extent zombie tree count */
 	atomic_t total_ext_node;		/* extent info count */
+	unsigned int extent_cache_budget;	/* max extent nodes added by reads */
+	unsigned int extent_cache_age;		/* secs before a node is aged out */
+	struct percpu_counter extent_cache_hit;	/* lookups served from the cache */
+	struct percpu_counter extent_cache_miss;	/* lookups that went to dnodes */
 
 	/* basic filesystem units */
 	unsigned int log_sectors_per_block;	/* log2 sectors per block */
@@ -3545,6 +3555,8 @@ struct rb_entry *f2fs_lookup_rb_tree_ret(struct rb_root *root,
 bool f2fs_check_rb_tree_consistence(struct f2fs_sb_info *sbi,
 						struct rb_root *root);
 unsigned int f2fs_shrink_extent_tree(struct f2fs_sb_info *sbi, int nr_shrink);
+unsigned int f2fs_shrink_aged_extent_nodes(struct f2fs_sb_info *sbi,
+						int nr_shrink);
 bool f2fs_init_extent_tree(struct inode *inode, struct f2fs_extent *i_ext);
 void f2fs_drop_extent_tree(struct inode *inode);
 unsigned int f2fs_destroy_extent_node(struct inode *inode);
@@ -3554,6 +3566,8 @@ bool f2fs_lookup_extent_cache(struct inode *inode, pgoff_t pgofs,
 void f2fs_update_extent_cache(struct dnode_of_data *dn);
 void f2fs_update_extent_cache_range(struct dnode_of_data *dn,
 			pgoff_t fofs, block_t blkaddr, unsigned int len);
+void f2fs_cache_read_extent(struct dnode_of_data *dn,
+			pgoff_t fofs, block_t blkaddr, unsigned int len);
 void f2fs_init_extent_cache_info(struct f2fs_sb_info *sbi);
 int __init f2fs_create_extent_cache(void);
 void f2fs_destroy_extent_cache(void);
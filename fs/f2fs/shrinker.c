@@ -101,8 +101,11 @@ unsigned long f2fs_shrink_scan(struct shrinker *shrink,
 
 		sbi->shrinker_run_no = run_no;
 
-		/* shrink extent cache entries */
-		freed += f2fs_shrink_extent_tree(sbi, nr >> 1);
+		/* shrink idle extent cache entries, then the LRU ones */
+		freed += f2fs_shrink_aged_extent_nodes(sbi, nr >> 1);
+		if (freed < nr >> 1)
+			freed += f2fs_shrink_extent_tree(sbi,
+						(nr >> 1) - freed);
 
 		/* shrink clean nat cache entries */
 		if (freed < nr)
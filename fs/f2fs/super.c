@@ -1022,6 +1022,8 @@ static void destroy_percpu_info(struct f2fs_sb_info *sbi)
 {
 	percpu_counter_destroy(&sbi->alloc_valid_block_count);
 	percpu_counter_destroy(&sbi->total_valid_inode_count);
+	percpu_counter_destroy(&sbi->extent_cache_hit);
+	percpu_counter_destroy(&sbi->extent_cache_miss);
 }
 
 static void destroy_device_list(struct f2fs_sb_info *sbi)
@@ -2858,8 +2860,24 @@ static int init_percpu_info(struct f2fs_sb_info *sbi)
 	err = percpu_counter_init(&sbi->total_valid_inode_count, 0,
 								GFP_KERNEL);
 	if (err)
-		percpu_counter_destroy(&sbi->alloc_valid_block_count);
+		goto free_alloc_valid;
 
+	err = percpu_counter_init(&sbi->extent_cache_hit, 0, GFP_KERNEL);
+	if (err)
+		goto free_valid_inode;
+
+	err = percpu_counter_init(&sbi->extent_cache_miss, 0, GFP_KERNEL);
+	if (err)
+		goto free_extent_hit;
+
+	return 0;
+
+free_extent_hit:
+	percpu_counter_destroy(&sbi->extent_cache_hit);
+free_valid_inode:
+	percpu_counter_destroy(&sbi->total_valid_inode_count);
+free_alloc_valid:
+	percpu_counter_destroy(&sbi->alloc_valid_block_count);
 	return err;
 }
 
@@ -161,6 +161,30 @@ static ssize_t unusable_show(struct f2fs_attr *a,
 	return sprintf(buf, "%llu\n", (unsigned long long)unusable);
 }
 
+static ssize_t extent_cache_hits_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	return sprintf(buf, "%lld\n",
+		percpu_counter_sum_positive(&sbi->extent_cache_hit));
+}
+
+static ssize_t extent_cache_misses_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	return sprintf(buf, "%lld\n",
+		percpu_counter_sum_positive(&sbi->extent_cache_miss));
+}
+
+static ssize_t extent_cache_bytes_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	return sprintf(buf, "%llu\n", (unsigned long long)
+		(atomic_read(&sbi->total_ext_tree) *
+				sizeof(struct extent_tree) +
+		atomic_read(&sbi->total_ext_node) *
+				sizeof(struct extent_node)));
+}
+
 #ifdef CONFIG_F2FS_STAT_FS
 static ssize_t moved_blocks_foreground_show(struct f2fs_attr *a,
 				struct f2fs_sb_info *sbi, char *buf)
@@ -503,6 +527,8 @@ F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, iostat_enable, iostat_enable);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, readdir_ra, readdir_ra);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_pin_file_thresh, gc_pin_file_threshold);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_super_block, extension_list, extension_list);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, extent_cache_budget, extent_cache_budget);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, extent_cache_age, extent_cache_age);
 #ifdef CONFIG_F2FS_FAULT_INJECTION
 F2FS_RW_ATTR(FAULT_INFO_RATE, f2fs_fault_info, inject_rate, inject_rate);
 F2FS_RW_ATTR(FAULT_INFO_TYPE, f2fs_fault_info, inject_type, inject_type);
@@ -513,6 +539,9 @@ F2FS_GENERAL_RO_ATTR(lifetime_write_kbytes);
 F2FS_GENERAL_RO_ATTR(features);
 F2FS_GENERAL_RO_ATTR(current_reserved_blocks);
 F2FS_GENERAL_RO_ATTR(unusable);
+F2FS_GENERAL_RO_ATTR(extent_cache_hits);
+F2FS_GENERAL_RO_ATTR(extent_cache_misses);
+F2FS_GENERAL_RO_ATTR(extent_cache_bytes);
 #ifdef CONFIG_F2FS_STAT_FS
 F2FS_STAT_ATTR(STAT_INFO, f2fs_stat_info, cp_foreground_calls, cp_count);
 F2FS_STAT_ATTR(STAT_INFO, f2fs_stat_info, cp_background_calls, bg_cp_count);
@@ -573,6 +602,8 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(readdir_ra),
 	ATTR_LIST(gc_pin_file_thresh),
 	ATTR_LIST(extension_list),
+	ATTR_LIST(extent_cache_budget),
+	ATTR_LIST(extent_cache_age),
 #ifdef CONFIG_F2FS_FAULT_INJECTION
 	ATTR_LIST(inject_rate),
 	ATTR_LIST(inject_type),
@@ -584,6 +615,9 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(features),
 	ATTR_LIST(reserved_blocks),
 	ATTR_LIST(current_reserved_blocks),
+	ATTR_LIST(extent_cache_hits),
+	ATTR_LIST(extent_cache_misses),
+	ATTR_LIST(extent_cache_bytes),
 #ifdef CONFIG_F2FS_STAT_FS
 	ATTR_LIST(cp_foreground_calls),
 	ATTR_LIST(cp_background_calls),
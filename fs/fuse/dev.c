@@ -22,6 +22,7 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/freezer.h>
+#include <linux/percpu.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -318,16 +319,104 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 
 static u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
-	return ++fiq->reqctr;
+	return atomic64_inc_return(&fiq->reqctr);
+}
+
+static struct fuse_cpu_iqueue __percpu *fuse_cpu_iqs(struct fuse_iqueue *fiq)
+{
+	/* pairs with smp_store_release() in fuse_dev_bind_cpu() */
+	return smp_load_acquire(&fiq->cpu_iqs);
+}
+
+/*
+ * Wake one idle reader bound to some per-cpu queue, it will find the
+ * work through stealing.  Must not be called with a per-cpu queue lock
+ * held.
+ */
+static void fuse_cpu_iq_wake_any(struct fuse_iqueue *fiq)
+{
+	struct fuse_cpu_iqueue __percpu *cpu_iqs = fuse_cpu_iqs(fiq);
+	int cpu;
+
+	/* pairs with set_current_state() in fuse_cpu_iq_get() */
+	smp_mb();
+	for_each_possible_cpu(cpu) {
+		struct fuse_cpu_iqueue *ciq = per_cpu_ptr(cpu_iqs, cpu);
+
+		if (waitqueue_active(&ciq->waitq)) {
+			wake_up(&ciq->waitq);
+			return;
+		}
+	}
+}
+
+/*
+ * Wake a reader for work queued on fiq itself.  Readers bound to a
+ * per-cpu queue don't sleep on fiq->waitq, so if nobody else does, wake
+ * one of those instead.  Called with fiq->waitq.lock held.
+ */
+static void fuse_iq_wake_locked(struct fuse_iqueue *fiq)
+{
+	if (fiq->cpu_iqs && !waitqueue_active(&fiq->waitq))
+		fuse_cpu_iq_wake_any(fiq);
+	else
+		wake_up_locked(&fiq->waitq);
 }
 
 static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->iq_lock = &fiq->waitq.lock;
 	list_add_tail(&req->list, &fiq->pending);
-	wake_up_locked(&fiq->waitq);
+	fuse_iq_wake_locked(fiq);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
+/*
+ * Queue a request on the calling cpu's input queue, without touching
+ * fiq->waitq.lock.  Returns false if per-cpu queues aren't in use or the
+ * connection is gone, in which case the caller falls back to
+ * queue_request().
+ */
+static bool queue_request_cpu(struct fuse_iqueue *fiq, struct fuse_req *req)
+{
+	struct fuse_cpu_iqueue __percpu *cpu_iqs = fuse_cpu_iqs(fiq);
+	struct fuse_cpu_iqueue *ciq;
+	bool woken = false;
+
+	if (!cpu_iqs)
+		return false;
+
+	ciq = per_cpu_ptr(cpu_iqs, raw_smp_processor_id());
+	spin_lock(&ciq->waitq.lock);
+	/* fuse_abort_conn() drains the queue under its lock after this */
+	if (!READ_ONCE(fiq->connected)) {
+		spin_unlock(&ciq->waitq.lock);
+		return false;
+	}
+	req->in.h.unique = fuse_get_unique(fiq);
+	req->in.h.len = sizeof(struct fuse_in_header) +
+		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->iq_lock = &ciq->waitq.lock;
+	list_add_tail(&req->list, &ciq->pending);
+	if (waitqueue_active(&ciq->waitq)) {
+		wake_up_locked(&ciq->waitq);
+		woken = true;
+	}
+	spin_unlock(&ciq->waitq.lock);
+
+	/* No idle reader on this cpu, let somebody else steal it */
+	if (!woken) {
+		/* pairs with set_current_state() in fuse_cpu_iq_get() */
+		smp_mb();
+		if (waitqueue_active(&fiq->waitq))
+			wake_up(&fiq->waitq);
+		else
+			fuse_cpu_iq_wake_any(fiq);
+	}
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+	return true;
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -342,7 +431,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 	if (fiq->connected) {
 		fiq->forget_list_tail->next = forget;
 		fiq->forget_list_tail = forget;
-		wake_up_locked(&fiq->waitq);
+		fuse_iq_wake_locked(fiq);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 	} else {
 		kfree(forget);
@@ -360,6 +449,8 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
+		if (queue_request_cpu(fiq, req))
+			continue;
 		spin_lock(&fiq->waitq.lock);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request(fiq, req);
@@ -382,6 +473,10 @@ static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 	if (test_and_set_bit(FR_FINISHED, &req->flags))
 		goto put_request;
 
+	/* The pages go back to their owner below */
+	if (req->ring)
+		fuse_ring_unmap_req(req);
+
 	spin_lock(&fiq->waitq.lock);
 	list_del_init(&req->intr_entry);
 	spin_unlock(&fiq->waitq.lock);
@@ -430,7 +525,7 @@ static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 	}
 	if (list_empty(&req->intr_entry)) {
 		list_add_tail(&req->intr_entry, &fiq->interrupts);
-		wake_up_locked(&fiq->waitq);
+		fuse_iq_wake_locked(fiq);
 	}
 	spin_unlock(&fiq->waitq.lock);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
@@ -462,16 +557,16 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		spin_lock(req->iq_lock);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
-			spin_unlock(&fiq->waitq.lock);
+			spin_unlock(req->iq_lock);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
 		}
-		spin_unlock(&fiq->waitq.lock);
+		spin_unlock(req->iq_lock);
 	}
 
 	/*
@@ -488,22 +583,25 @@ static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_iqueue *fiq = &fc->iq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
-	if (!fiq->connected) {
-		spin_unlock(&fiq->waitq.lock);
-		req->out.h.error = -ENOTCONN;
-	} else {
+	/* acquire extra reference, since request is still needed
+	   after request_end() */
+	__fuse_get_request(req);
+	if (!queue_request_cpu(fiq, req)) {
+		spin_lock(&fiq->waitq.lock);
+		if (!fiq->connected) {
+			spin_unlock(&fiq->waitq.lock);
+			__fuse_put_request(req);
+			req->out.h.error = -ENOTCONN;
+			return;
+		}
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request(fiq, req);
-		/* acquire extra reference, since request is still needed
-		   after request_end() */
-		__fuse_get_request(req);
 		spin_unlock(&fiq->waitq.lock);
-
-		request_wait_answer(fc, req);
-		/* Pairs with smp_wmb() in request_end() */
-		smp_rmb();
 	}
+
+	request_wait_answer(fc, req);
+	/* Pairs with smp_wmb() in request_end() */
+	smp_rmb();
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
@@ -1257,6 +1355,115 @@ __releases(fiq->waitq.lock)
 		return fuse_read_batch_forget(fiq, cs, nbytes);
 }
 
+static struct fuse_req *fuse_cpu_iq_dequeue(struct fuse_cpu_iqueue *ciq)
+{
+	struct fuse_req *req = NULL;
+
+	if (list_empty_careful(&ciq->pending))
+		return NULL;
+
+	spin_lock(&ciq->waitq.lock);
+	if (!list_empty(&ciq->pending)) {
+		req = list_first_entry(&ciq->pending, struct fuse_req, list);
+		clear_bit(FR_PENDING, &req->flags);
+		list_del_init(&req->list);
+	}
+	spin_unlock(&ciq->waitq.lock);
+
+	return req;
+}
+
+/*
+ * Take a request from our own queue, or steal the oldest one from the
+ * next non-empty queue, starting at the local cpu.
+ */
+static struct fuse_req *fuse_cpu_iq_steal(struct fuse_iqueue *fiq,
+					  struct fuse_cpu_iqueue *own)
+{
+	struct fuse_cpu_iqueue __percpu *cpu_iqs = fuse_cpu_iqs(fiq);
+	unsigned int i, cpu = raw_smp_processor_id();
+	struct fuse_req *req;
+
+	if (own) {
+		req = fuse_cpu_iq_dequeue(own);
+		if (req)
+			return req;
+	}
+
+	for (i = 0; i < nr_cpu_ids; i++, cpu++) {
+		struct fuse_cpu_iqueue *ciq;
+
+		if (cpu >= nr_cpu_ids)
+			cpu = 0;
+		if (!cpu_possible(cpu))
+			continue;
+		ciq = per_cpu_ptr(cpu_iqs, cpu);
+		if (ciq == own)
+			continue;
+		req = fuse_cpu_iq_dequeue(ciq);
+		if (req)
+			return req;
+	}
+
+	return NULL;
+}
+
+static bool fuse_cpu_iq_pending(struct fuse_iqueue *fiq)
+{
+	struct fuse_cpu_iqueue __percpu *cpu_iqs = fuse_cpu_iqs(fiq);
+	int cpu;
+
+	if (!cpu_iqs)
+		return false;
+
+	for_each_possible_cpu(cpu) {
+		if (!list_empty_careful(&per_cpu_ptr(cpu_iqs, cpu)->pending))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Wait for work with per-cpu queues in use.  Bound readers sleep on their
+ * own queue, others on fiq->waitq.  Returns a request taken off one of
+ * the per-cpu queues, or NULL if there's work queued on fiq itself.
+ */
+static struct fuse_req *fuse_cpu_iq_get(struct fuse_dev *fud,
+					struct file *file)
+{
+	struct fuse_iqueue *fiq = &fud->fc->iq;
+	struct fuse_cpu_iqueue *own = fud->ciq;
+	wait_queue_head_t *wq = own ? &own->waitq : &fiq->waitq;
+	struct fuse_req *req = NULL;
+	DEFINE_WAIT(wait);
+	int err = 0;
+
+	for (;;) {
+		prepare_to_wait_exclusive(wq, &wait, TASK_INTERRUPTIBLE);
+		if (!READ_ONCE(fiq->connected)) {
+			err = -ENODEV;
+			break;
+		}
+		if (request_pending(fiq))
+			break;
+		req = fuse_cpu_iq_steal(fiq, own);
+		if (req)
+			break;
+		if (file->f_flags & O_NONBLOCK) {
+			err = -EAGAIN;
+			break;
+		}
+		if (signal_pending(current)) {
+			err = -ERESTARTSYS;
+			break;
+		}
+		schedule();
+	}
+	finish_wait(wq, &wait);
+
+	return err ? ERR_PTR(err) : req;
+}
+
 /*
  * Read a single request into the userspace filesystem's buffer.  This
  * function waits until a request is available, then removes it from
@@ -1278,14 +1485,23 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	unsigned reqsize;
 
  restart:
+	if (fuse_cpu_iqs(fiq)) {
+		req = fuse_cpu_iq_get(fud, file);
+		if (IS_ERR(req))
+			return PTR_ERR(req);
+		if (req)
+			goto dequeued;
+	}
+
 	spin_lock(&fiq->waitq.lock);
 	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fiq->connected &&
-	    !request_pending(fiq))
+	    !request_pending(fiq) && !fiq->cpu_iqs)
 		goto err_unlock;
 
 	err = wait_event_interruptible_exclusive_locked(fiq->waitq,
-				!fiq->connected || request_pending(fiq));
+				!fiq->connected || request_pending(fiq) ||
+				fiq->cpu_iqs);
 	if (err)
 		goto err_unlock;
 
@@ -1293,6 +1509,12 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	if (!fiq->connected)
 		goto err_unlock;
 
+	/* Switched to per-cpu queues, or another reader got here first */
+	if (!request_pending(fiq)) {
+		spin_unlock(&fiq->waitq.lock);
+		goto restart;
+	}
+
 	if (!list_empty(&fiq->interrupts)) {
 		req = list_entry(fiq->interrupts.next, struct fuse_req,
 				 intr_entry);
@@ -1312,7 +1534,9 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	list_del_init(&req->list);
 	spin_unlock(&fiq->waitq.lock);
 
+ dequeued:
 	in = &req->in;
+	fuse_ring_map_req(fud, req);
 	reqsize = in->h.len;
 	/* If request is too large, reply with an error and restart the read */
 	if (nbytes < reqsize) {
@@ -2098,11 +2322,13 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 
 	fiq = &fud->fc->iq;
 	poll_wait(file, &fiq->waitq, wait);
+	if (fud->ciq)
+		poll_wait(file, &fud->ciq->waitq, wait);
 
 	spin_lock(&fiq->waitq.lock);
 	if (!fiq->connected)
 		mask = POLLERR;
-	else if (request_pending(fiq))
+	else if (request_pending(fiq) || fuse_cpu_iq_pending(fiq))
 		mask |= POLLIN | POLLRDNORM;
 	spin_unlock(&fiq->waitq.lock);
 
@@ -2141,6 +2367,28 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * Move everything queued on the per-cpu queues to @head and wake up the
+ * readers bound to them.  Called with fiq->waitq.lock held, after
+ * fiq->connected was cleared.
+ */
+static void fuse_cpu_iq_abort(struct fuse_iqueue *fiq, struct list_head *head)
+{
+	struct fuse_req *req;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_cpu_iqueue *ciq = per_cpu_ptr(fiq->cpu_iqs, cpu);
+
+		spin_lock(&ciq->waitq.lock);
+		list_for_each_entry(req, &ciq->pending, list)
+			clear_bit(FR_PENDING, &req->flags);
+		list_splice_tail_init(&ciq->pending, head);
+		wake_up_all_locked(&ciq->waitq);
+		spin_unlock(&ciq->waitq.lock);
+	}
+}
+
 /*
  * Abort all requests.
  *
@@ -2200,6 +2448,8 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		list_splice_init(&fiq->pending, &to_end2);
 		list_for_each_entry(req, &to_end2, list)
 			clear_bit(FR_PENDING, &req->flags);
+		if (fiq->cpu_iqs)
+			fuse_cpu_iq_abort(fiq, &to_end2);
 		while (forget_pending(fiq))
 			kfree(dequeue_forget(fiq, 1, NULL));
 		wake_up_all_locked(&fiq->waitq);
@@ -2283,6 +2533,44 @@ static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
 	return 0;
 }
 
+/*
+ * Bind @fud to the input queue of @cpu, switching the connection over to
+ * per-cpu queues on first use.  Several devices may be bound to the same
+ * cpu; queues nobody is bound to are drained by stealing.
+ */
+static int fuse_dev_bind_cpu(struct fuse_dev *fud, unsigned int cpu)
+{
+	struct fuse_iqueue *fiq = &fud->fc->iq;
+	struct fuse_cpu_iqueue __percpu *cpu_iqs;
+	int i;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	cpu_iqs = fiq->cpu_iqs;
+	if (!cpu_iqs) {
+		cpu_iqs = alloc_percpu(struct fuse_cpu_iqueue);
+		if (!cpu_iqs)
+			return -ENOMEM;
+
+		for_each_possible_cpu(i) {
+			struct fuse_cpu_iqueue *ciq = per_cpu_ptr(cpu_iqs, i);
+
+			init_waitqueue_head(&ciq->waitq);
+			INIT_LIST_HEAD(&ciq->pending);
+		}
+
+		spin_lock(&fiq->waitq.lock);
+		smp_store_release(&fiq->cpu_iqs, cpu_iqs);
+		/* Readers sleeping the old way need to switch over */
+		wake_up_all_locked(&fiq->waitq);
+		spin_unlock(&fiq->waitq.lock);
+	}
+	fud->ciq = per_cpu_ptr(cpu_iqs, cpu);
+
+	return 0;
+}
+
 static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			   unsigned long arg)
 {
@@ -2315,6 +2603,19 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				fput(old);
 			}
 		}
+	} else if (cmd == FUSE_DEV_IOC_BIND_CPU) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		__u32 cpu;
+
+		err = -EINVAL;
+		if (fud && file->f_op == &fuse_dev_operations) {
+			err = -EFAULT;
+			if (!get_user(cpu, (__u32 __user *) arg)) {
+				mutex_lock(&fuse_mutex);
+				err = fuse_dev_bind_cpu(fud, cpu);
+				mutex_unlock(&fuse_mutex);
+			}
+		}
 	}
 	return err;
 }
@@ -2328,6 +2629,7 @@ const struct file_operations fuse_dev_operations = {
 	.write_iter	= fuse_dev_write,
 	.splice_write	= fuse_dev_splice_write,
 	.poll		= fuse_dev_poll,
+	.mmap		= fuse_dev_mmap,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
 	.unlocked_ioctl = fuse_dev_ioctl,
@@ -7,6 +7,7 @@
 */
 
 #include "fuse_i.h"
+#include "fuse_passthrough.h"
 
 #include <linux/pagemap.h>
 #include <linux/file.h>
@@ -1415,6 +1416,7 @@ static int fuse_readdir(struct file *file, struct dir_context *ctx)
 	struct page *page;
 	struct inode *inode = file_inode(file);
 	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_file *ff = file->private_data;
 	struct fuse_req *req;
 	u64 attr_version = 0;
 	bool locked;
@@ -1422,6 +1424,9 @@ static int fuse_readdir(struct file *file, struct dir_context *ctx)
 	if (fuse_is_bad(inode))
 		return -EIO;
 
+	if (ff->passthrough_enabled && ff->passthrough_filp)
+		return fuse_passthrough_readdir(file, ctx);
+
 	req = fuse_get_req(fc, 1);
 	if (IS_ERR(req))
 		return PTR_ERR(req);
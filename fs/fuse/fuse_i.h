@@ -10,6 +10,7 @@
 #define _FS_FUSE_I_H
 
 #include <linux/fuse.h>
+#include <linux/fuse_ring.h>
 #include <linux/fs.h>
 #include <linux/mount.h>
 #include <linux/wait.h>
@@ -40,6 +41,14 @@
 /** Number of page pointers embedded in fuse_req */
 #define FUSE_REQ_INLINE_PAGES 1
 
+/** Bind a /dev/fuse instance to the input queue of the given cpu */
+#ifndef FUSE_DEV_IOC_BIND_CPU
+#define FUSE_DEV_IOC_BIND_CPU	_IOW(FUSE_DEV_IOC_MAGIC, 100, __u32)
+#endif
+
+/** Size of one slot of a mapped /dev/fuse fd, see ring.c */
+#define FUSE_RING_SLOT_SIZE	(FUSE_RING_SLOT_PAGES * PAGE_SIZE)
+
 /** List of active connections */
 extern struct list_head fuse_conn_list;
 
@@ -320,6 +329,9 @@ struct fuse_req {
 	/** Unique ID for the interrupt request */
 	u64 intr_unique;
 
+	/** Lock of the input queue the request is pending on */
+	spinlock_t *iq_lock;
+
 	/* Request flags, updated with test/set/clear_bit() */
 	unsigned long flags;
 
@@ -394,6 +406,15 @@ struct fuse_req {
 
 	/** fuse passthrough file  */
 	struct file *passthrough_filp;
+
+	/** Mapping the data pages are mapped into, or NULL */
+	struct fuse_ring *ring;
+
+	/** Slot of the mapping in use */
+	unsigned ring_slot;
+
+	/** Sent in place of the data when mapped */
+	struct fuse_mapped_in ring_in;
 };
 
 struct fuse_iqueue {
@@ -404,7 +425,7 @@ struct fuse_iqueue {
 	wait_queue_head_t waitq;
 
 	/** The next unique request id */
-	u64 reqctr;
+	atomic64_t reqctr;
 
 	/** The list of pending requests */
 	struct list_head pending;
@@ -421,6 +442,24 @@ struct fuse_iqueue {
 
 	/** O_ASYNC requests */
 	struct fasync_struct *fasync;
+
+	/** Per-cpu input queues, set once the first device is bound */
+	struct fuse_cpu_iqueue __percpu *cpu_iqs;
+};
+
+/**
+ * Input queue of a single cpu
+ *
+ * Requests are queued on the submitting cpu's queue, readers bound to it
+ * sleep on its waitq and readers with nothing to do steal from the
+ * others.  Interrupts, forgets and notify replies stay on fuse_iqueue.
+ */
+struct fuse_cpu_iqueue {
+	/** Bound readers wait here, the lock protects the pending list */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
 };
 
 struct fuse_pqueue {
@@ -449,6 +488,12 @@ struct fuse_dev {
 
 	/** list entry on fc->devices */
 	struct list_head entry;
+
+	/** Input queue this device is bound to or NULL */
+	struct fuse_cpu_iqueue *ciq;
+
+	/** Mapping set up with mmap() on the device, or NULL */
+	struct fuse_ring *ring;
 };
 
 /**
@@ -912,6 +957,14 @@ void fuse_conn_put(struct fuse_conn *fc);
 struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
 void fuse_dev_free(struct fuse_dev *fud);
 
+/**
+ * Map WRITE payloads into the daemon instead of copying them
+ */
+int fuse_dev_mmap(struct file *file, struct vm_area_struct *vma);
+void fuse_ring_map_req(struct fuse_dev *fud, struct fuse_req *req);
+void fuse_ring_unmap_req(struct fuse_req *req);
+void fuse_ring_put(struct fuse_ring *ring);
+
 /**
  * Add connection to control filesystem
  */
@@ -20,12 +20,37 @@
 #include <linux/fuse.h>
 #include <linux/file.h>
 
+/*
+ * open_flags bit for FUSE_OPENDIR replies: the directory's entries are
+ * exactly those of the lower directory passed in passthrough_fd, so
+ * readdir may be served from it.
+ *
+ * Entries are returned as the lower filesystem reports them, d_ino
+ * included.  A daemon setting this flag must report the lower st_ino as
+ * fuse_attr.ino for those entries, or readdir and stat will disagree.
+ */
+#ifndef FOPEN_PASSTHROUGH_DIR
+#define FOPEN_PASSTHROUGH_DIR	(1U << 31)
+#endif
+
 void fuse_setup_passthrough(struct fuse_conn *fc, struct fuse_req *req);
 
 ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
 
 ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
 
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags);
+
+ssize_t fuse_passthrough_splice_write(struct pipe_inode_info *pipe,
+				      struct file *out, loff_t *ppos,
+				      size_t len, unsigned int flags);
+
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx);
+
 void fuse_passthrough_release(struct fuse_file *ff);
 
 #endif /* _FS_FUSE_PASSTHROUGH_H */
@@ -643,6 +643,7 @@ void fuse_conn_put(struct fuse_conn *fc)
 	if (atomic_dec_and_test(&fc->count)) {
 		if (fc->destroy_req)
 			fuse_request_free(fc->destroy_req);
+		free_percpu(fc->iq.cpu_iqs);
 		fc->release(fc);
 	}
 }
@@ -1059,6 +1060,7 @@ void fuse_dev_free(struct fuse_dev *fud)
 
 		fuse_conn_put(fc);
 	}
+	fuse_ring_put(fud->ring);
 	kfree(fud);
 }
 EXPORT_SYMBOL_GPL(fuse_dev_free);
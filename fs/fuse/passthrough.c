@@ -16,6 +16,7 @@
 
 #include <linux/aio.h>
 #include <linux/fs_stack.h>
+#include <linux/mm.h>
 
 void fuse_setup_passthrough(struct fuse_conn *fc, struct fuse_req *req)
 {
@@ -32,7 +33,8 @@ void fuse_setup_passthrough(struct fuse_conn *fc, struct fuse_req *req)
 		return;
 
 	if ((req->in.h.opcode != FUSE_OPEN) &&
-	    (req->in.h.opcode != FUSE_CREATE))
+	    (req->in.h.opcode != FUSE_CREATE) &&
+	    (req->in.h.opcode != FUSE_OPENDIR))
 		return;
 
 	open_out_index = req->in.numargs - 1;
@@ -42,6 +44,11 @@ void fuse_setup_passthrough(struct fuse_conn *fc, struct fuse_req *req)
 
 	open_out = req->out.args[open_out_index].value;
 
+	/* Directories are only passed through when the daemon opts in */
+	if (req->in.h.opcode == FUSE_OPENDIR &&
+	    !(open_out->open_flags & FOPEN_PASSTHROUGH_DIR))
+		return;
+
 	daemon_fd = (int)open_out->passthrough_fd;
 	if (daemon_fd < 0)
 		return;
@@ -51,6 +58,11 @@ void fuse_setup_passthrough(struct fuse_conn *fc, struct fuse_req *req)
 		return;
 
 	passthrough_inode = file_inode(passthrough_filp);
+	if (S_ISDIR(passthrough_inode->i_mode) !=
+	    (req->in.h.opcode == FUSE_OPENDIR)) {
+		fput(passthrough_filp);
+		return;
+	}
 	passthrough_sb = passthrough_inode->i_sb;
 	fs_stack_depth = passthrough_sb->s_stack_depth + 1;
 
@@ -124,6 +136,112 @@ ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	return fuse_passthrough_read_write_iter(iocb, from, 1);
 }
 
+/*
+ * Map the lower file's page cache directly, so page faults never reach
+ * the daemon.  The vma holds the lower file from here on.  Returns
+ * -ENODEV if the caller should fall back to a regular fuse mapping.
+ */
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	int ret_val;
+
+	if (!passthrough_filp->f_op->mmap)
+		return -ENODEV;
+
+	/* The lower file must allow what the mapping may do to it */
+	if ((vma->vm_flags & VM_SHARED) && (vma->vm_flags & VM_MAYWRITE) &&
+	    !(passthrough_filp->f_mode & FMODE_WRITE))
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	vma->vm_file = get_file(passthrough_filp);
+	ret_val = passthrough_filp->f_op->mmap(passthrough_filp, vma);
+	if (ret_val) {
+		vma->vm_file = file;
+		fput(passthrough_filp);
+		return ret_val;
+	}
+	/* drop the reference mmap_region() took for the fuse file */
+	fput(file);
+
+	fsstack_copy_attr_atime(file_inode(file), file_inode(passthrough_filp));
+	return 0;
+}
+
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags)
+{
+	struct fuse_file *ff = in->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	ssize_t ret_val;
+
+	if (!passthrough_filp->f_op->splice_read)
+		return generic_file_splice_read(in, ppos, pipe, len, flags);
+
+	ret_val = passthrough_filp->f_op->splice_read(passthrough_filp, ppos,
+						      pipe, len, flags);
+	if (ret_val >= 0)
+		fsstack_copy_attr_atime(file_inode(in),
+					file_inode(passthrough_filp));
+	return ret_val;
+}
+
+ssize_t fuse_passthrough_splice_write(struct pipe_inode_info *pipe,
+				      struct file *out, loff_t *ppos,
+				      size_t len, unsigned int flags)
+{
+	struct fuse_file *ff = out->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	struct inode *fuse_inode = file_inode(out);
+	struct inode *passthrough_inode = file_inode(passthrough_filp);
+	struct fuse_conn *fc = ff->fc;
+	ssize_t ret_val;
+
+	file_start_write(passthrough_filp);
+	if (passthrough_filp->f_op->splice_write)
+		ret_val = passthrough_filp->f_op->splice_write(pipe,
+				passthrough_filp, ppos, len, flags);
+	else
+		ret_val = iter_file_splice_write(pipe, passthrough_filp, ppos,
+						 len, flags);
+	file_end_write(passthrough_filp);
+
+	if (ret_val >= 0) {
+		spin_lock(&fc->lock);
+		fsstack_copy_inode_size(fuse_inode, passthrough_inode);
+		spin_unlock(&fc->lock);
+		fsstack_copy_attr_times(fuse_inode, passthrough_inode);
+	}
+	return ret_val;
+}
+
+/*
+ * Only set up for directories opened with FOPEN_PASSTHROUGH_DIR, whose
+ * entries the daemon vouches to be the lower directory's unchanged, inode
+ * numbers included: d_ino is passed through from the lower filesystem.
+ */
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	int ret_val;
+
+	/*
+	 * The lower file is private to this one, whose position lock we
+	 * are under, so just carry the position across.
+	 */
+	passthrough_filp->f_pos = ctx->pos;
+	ret_val = iterate_dir(passthrough_filp, ctx);
+	fsstack_copy_attr_atime(file_inode(file), file_inode(passthrough_filp));
+
+	return ret_val;
+}
+
 void fuse_passthrough_release(struct fuse_file *ff)
 {
 	if (!(ff->passthrough_filp))
@@ -0,0 +1,296 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Mapped WRITE payloads
+ *
+ * A daemon may mmap() a /dev/fuse fd read-only and shared, at offset 0,
+ * with a length that is a multiple of FUSE_RING_SLOT_SIZE.  The mapping
+ * is split into slots of FUSE_MAX_PAGES_PER_REQ pages.  When a FUSE_WRITE
+ * request is read from that fd by the process owning the mapping, and
+ * its data sits contiguously in the request's pages, the pages are mapped
+ * into a free slot instead of being copied into the read buffer.  The
+ * request then carries FUSE_WRITE_MAPPED in write_flags and a struct
+ * fuse_mapped_in in place of the data, giving the offset of the first
+ * byte within the mapping.
+ *
+ * The slot stays mapped until the request is answered or aborted, so the
+ * data must not be accessed after replying.  Requests that can't be
+ * mapped are sent the usual way.  The flag, struct and slot size are
+ * defined in <uapi/linux/fuse_ring.h>.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/kref.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+/* 32MB of mapping with 4k pages */
+#define FUSE_RING_MAX_SLOTS	256
+
+struct fuse_ring {
+	struct kref kref;
+
+	/** Protects the slot bitmap */
+	spinlock_t lock;
+
+	/** The mapping, NULL once it's gone; stable under mm->mmap_sem */
+	struct vm_area_struct *vma;
+
+	/** Owner of the mapping, holds an mm_count reference */
+	struct mm_struct *mm;
+
+	unsigned int nr_slots;
+	unsigned long used[];
+};
+
+static void fuse_ring_free(struct kref *kref)
+{
+	struct fuse_ring *ring = container_of(kref, struct fuse_ring, kref);
+
+	mmdrop(ring->mm);
+	kfree(ring);
+}
+
+void fuse_ring_put(struct fuse_ring *ring)
+{
+	if (ring)
+		kref_put(&ring->kref, fuse_ring_free);
+}
+
+/*
+ * Splitting the mapping, trying to move it or unmapping any part of it
+ * detaches the ring, after which requests are copied again.  The pages
+ * of requests still in flight hold no reference of their own, so every
+ * slot is zapped before the ring lets go of the vma: nothing may stay
+ * mapped that fuse_ring_unmap_req() can no longer reach.  Both run with
+ * mmap_sem held for writing.
+ */
+static void fuse_ring_detach(struct fuse_ring *ring)
+{
+	struct vm_area_struct *vma = ring->vma;
+
+	if (!vma)
+		return;
+
+	zap_vma_ptes(vma, vma->vm_start, vma->vm_end - vma->vm_start);
+	WRITE_ONCE(ring->vma, NULL);
+}
+
+static void fuse_ring_vm_open(struct vm_area_struct *vma)
+{
+	fuse_ring_detach(vma->vm_private_data);
+}
+
+static void fuse_ring_vm_close(struct vm_area_struct *vma)
+{
+	fuse_ring_detach(vma->vm_private_data);
+}
+
+static int fuse_ring_vm_fault(struct vm_area_struct *vma,
+			      struct vm_fault *vmf)
+{
+	/* Only slots of requests in flight have anything behind them */
+	return VM_FAULT_SIGBUS;
+}
+
+static int fuse_ring_vm_mremap(struct vm_area_struct *vma)
+{
+	return -EINVAL;
+}
+
+static const struct vm_operations_struct fuse_ring_vm_ops = {
+	.open		= fuse_ring_vm_open,
+	.close		= fuse_ring_vm_close,
+	.fault		= fuse_ring_vm_fault,
+	.mremap		= fuse_ring_vm_mremap,
+};
+
+int fuse_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_dev *fud = file->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct fuse_ring *ring;
+	unsigned int nr_slots;
+
+	BUILD_BUG_ON(FUSE_RING_SLOT_PAGES != FUSE_MAX_PAGES_PER_REQ);
+
+	if (!fud)
+		return -EPERM;
+
+	if (vma->vm_pgoff || (vma->vm_flags & VM_WRITE) ||
+	    !(vma->vm_flags & VM_SHARED) || size % FUSE_RING_SLOT_SIZE)
+		return -EINVAL;
+
+	nr_slots = size / FUSE_RING_SLOT_SIZE;
+	if (nr_slots > FUSE_RING_MAX_SLOTS)
+		return -EINVAL;
+
+	ring = kzalloc(sizeof(*ring) +
+		       BITS_TO_LONGS(nr_slots) * sizeof(unsigned long),
+		       GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	kref_init(&ring->kref);
+	spin_lock_init(&ring->lock);
+	ring->vma = vma;
+	ring->mm = current->mm;
+	atomic_inc(&ring->mm->mm_count);
+	ring->nr_slots = nr_slots;
+
+	/* One mapping per fd for its lifetime */
+	if (cmpxchg(&fud->ring, NULL, ring)) {
+		fuse_ring_put(ring);
+		return -EBUSY;
+	}
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_PFNMAP | VM_IO | VM_DONTEXPAND | VM_DONTDUMP |
+			 VM_DONTCOPY;
+	vma->vm_private_data = ring;
+	vma->vm_ops = &fuse_ring_vm_ops;
+
+	return 0;
+}
+
+/* The data has to look like one run of bytes to the daemon */
+static bool fuse_ring_contiguous(struct fuse_req *req, unsigned size)
+{
+	unsigned i, len = 0;
+
+	if (!req->num_pages || req->num_pages > FUSE_MAX_PAGES_PER_REQ)
+		return false;
+
+	for (i = 0; i < req->num_pages; i++) {
+		struct fuse_page_desc *desc = &req->page_descs[i];
+
+		if (i && desc->offset)
+			return false;
+		if (i < req->num_pages - 1 &&
+		    desc->offset + desc->length != PAGE_SIZE)
+			return false;
+		len += desc->length;
+	}
+
+	return len == size;
+}
+
+static int fuse_ring_get_slot(struct fuse_ring *ring)
+{
+	int slot;
+
+	spin_lock(&ring->lock);
+	slot = find_first_zero_bit(ring->used, ring->nr_slots);
+	if (slot < ring->nr_slots)
+		__set_bit(slot, ring->used);
+	else
+		slot = -1;
+	spin_unlock(&ring->lock);
+
+	return slot;
+}
+
+static void fuse_ring_put_slot(struct fuse_ring *ring, unsigned int slot)
+{
+	spin_lock(&ring->lock);
+	__clear_bit(slot, ring->used);
+	spin_unlock(&ring->lock);
+}
+
+/*
+ * Called by the reader before the request is copied out.  On success the
+ * data argument is replaced by its location in the mapping.
+ */
+void fuse_ring_map_req(struct fuse_dev *fud, struct fuse_req *req)
+{
+	struct fuse_ring *ring = smp_load_acquire(&fud->ring);
+	struct fuse_in *in = &req->in;
+	struct vm_area_struct *vma;
+	unsigned long addr;
+	unsigned i;
+	int slot;
+
+	if (!ring || current->mm != ring->mm)
+		return;
+
+	if (in->h.opcode != FUSE_WRITE || !in->argpages || in->numargs != 2 ||
+	    in->args[0].value != &req->misc.write.in ||
+	    !fuse_ring_contiguous(req, in->args[1].size))
+		return;
+
+	slot = fuse_ring_get_slot(ring);
+	if (slot < 0)
+		return;
+
+	down_read(&ring->mm->mmap_sem);
+	vma = READ_ONCE(ring->vma);
+	if (!vma)
+		goto out_unlock;
+
+	addr = vma->vm_start + slot * FUSE_RING_SLOT_SIZE;
+	for (i = 0; i < req->num_pages; i++) {
+		if (vm_insert_pfn(vma, addr + i * PAGE_SIZE,
+				  page_to_pfn(req->pages[i]))) {
+			if (i)
+				zap_vma_ptes(vma, addr, i * PAGE_SIZE);
+			goto out_unlock;
+		}
+	}
+	up_read(&ring->mm->mmap_sem);
+
+	kref_get(&ring->kref);
+	req->ring = ring;
+	req->ring_slot = slot;
+	req->ring_in.offset = slot * FUSE_RING_SLOT_SIZE +
+			      req->page_descs[0].offset;
+
+	req->misc.write.in.write_flags |= FUSE_WRITE_MAPPED;
+	in->h.len -= in->args[1].size;
+	in->h.len += sizeof(req->ring_in);
+	in->args[1].size = sizeof(req->ring_in);
+	in->args[1].value = &req->ring_in;
+	in->argpages = 0;
+	return;
+
+ out_unlock:
+	up_read(&ring->mm->mmap_sem);
+	fuse_ring_put_slot(ring, slot);
+}
+
+/*
+ * Tear down the slot of a finished request, before its pages are given
+ * back.  Called from request_end(), which may run in any process.
+ */
+void fuse_ring_unmap_req(struct fuse_req *req)
+{
+	struct fuse_ring *ring = req->ring;
+	struct mm_struct *mm = ring->mm;
+	struct vm_area_struct *vma;
+
+	/*
+	 * If the owner is exiting its mappings are being torn down anyway,
+	 * and a detached ring had all its slots zapped by fuse_ring_detach().
+	 */
+	if (atomic_inc_not_zero(&mm->mm_users)) {
+		down_read(&mm->mmap_sem);
+		vma = READ_ONCE(ring->vma);
+		if (vma)
+			zap_vma_ptes(vma,
+				     vma->vm_start +
+				     req->ring_slot * FUSE_RING_SLOT_SIZE,
+				     FUSE_RING_SLOT_SIZE);
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+
+	fuse_ring_put_slot(ring, req->ring_slot);
+	req->ring = NULL;
+	fuse_ring_put(ring);
+}
@@ -106,6 +106,9 @@ static int sdcardfs_d_revalidate(struct dentry *dentry, unsigned int flags)
 	/* If our top's inode is gone, we may be out of date */
 	inode = igrab(d_inode(dentry));
 	if (inode) {
+		/* Pick up packages.list changes for app directories */
+		if (refresh_package_data(SDCARDFS_I(inode)->data))
+			fixup_tmp_permissions(inode);
 		data = top_data_get(SDCARDFS_I(inode));
 		if (!data || data->abandoned) {
 			err = 0;
@@ -48,6 +48,70 @@ void setup_derived_state(struct inode *inode, perm_t perm, userid_t userid,
 	info->data->under_obb = false;
 }
 
+/*
+ * Remember a package directory's name so its owner can be re-derived
+ * without the dentry.  Called under spinlocks, and possibly concurrently
+ * for the same inode; readers are under rcu_read_lock().  If the copy
+ * can't be allocated the directory just keeps its current owner.
+ */
+static void set_package_name(struct sdcardfs_inode_data *data,
+				const struct qstr *name)
+{
+	struct sdcardfs_pkg_name *new, *old;
+
+	rcu_read_lock();
+	old = rcu_dereference(data->pkg_name);
+	if (old && !strcmp(old->name, name->name)) {
+		rcu_read_unlock();
+		return;
+	}
+	rcu_read_unlock();
+
+	new = kmalloc(sizeof(*new) + name->len + 1, GFP_ATOMIC);
+	if (new) {
+		memcpy(new->name, name->name, name->len);
+		new->name[name->len] = 0;
+	}
+	old = xchg(&data->pkg_name, new);
+	if (old)
+		kfree_rcu(old, rcu);
+}
+
+/*
+ * The owner of a package directory comes from packages.list, which can
+ * change at any time.  Rather than walking the dentry tree on every
+ * change, look it up again when the list's generation has moved since.
+ * Returns true if @data was updated.
+ */
+bool refresh_package_data(struct sdcardfs_inode_data *data)
+{
+	unsigned int gen = get_packagelist_gen();
+	struct sdcardfs_pkg_name *pkg;
+	appid_t appid;
+	uid_t d_uid;
+
+	if (data->perm != PERM_ANDROID_PACKAGE ||
+			READ_ONCE(data->pkg_gen) == gen)
+		return false;
+
+	rcu_read_lock();
+	pkg = rcu_dereference(data->pkg_name);
+	if (!pkg) {
+		rcu_read_unlock();
+		return false;
+	}
+	d_uid = data->pkg_base_uid;
+	appid = get_appid(pkg->name);
+	if (appid != 0 && !is_excluded(pkg->name, data->userid))
+		d_uid = multiuser_get_uid(data->userid, appid);
+	rcu_read_unlock();
+
+	data->d_uid = d_uid;
+	smp_wmb();
+	WRITE_ONCE(data->pkg_gen, gen);
+	return true;
+}
+
 /* While renaming, there is a point where we want the path from dentry,
  * but the name from newdentry
  */
@@ -59,6 +123,7 @@ void get_derived_permission_new(struct inode *parent, struct inode *inode,
 	struct sdcardfs_inode_data *parent_data = parent_info->data;
 	appid_t appid;
 	unsigned long user_num;
+	unsigned int gen;
 	int err;
 	struct qstr q_Android = QSTR_LITERAL("Android");
 	struct qstr q_data = QSTR_LITERAL("data");
@@ -130,10 +195,16 @@ void get_derived_permission_new(struct inode *parent, struct inode *inode,
 	case PERM_ANDROID_DATA:
 	case PERM_ANDROID_MEDIA:
 		info->data->perm = PERM_ANDROID_PACKAGE;
+		/* sample first, so a racing list change forces a refresh */
+		gen = get_packagelist_gen();
+		info->data->pkg_base_uid = info->data->d_uid;
 		appid = get_appid(name->name);
 		if (appid != 0 && !is_excluded(name->name, parent_data->userid))
 			info->data->d_uid =
 				multiuser_get_uid(parent_data->userid, appid);
+		set_package_name(info->data, name);
+		smp_wmb();
+		WRITE_ONCE(info->data->pkg_gen, gen);
 		break;
 	case PERM_ANDROID_PACKAGE:
 		if (qstr_case_eq(name, &q_cache)) {
@@ -266,71 +337,6 @@ void fixup_lower_ownership(struct dentry *dentry, const char *name)
 	sdcardfs_put_lower_path(dentry, &path);
 }
 
-static int descendant_may_need_fixup(struct sdcardfs_inode_data *data,
-		struct limit_search *limit)
-{
-	if (data->perm == PERM_ROOT)
-		return (limit->flags & BY_USERID) ?
-				data->userid == limit->userid : 1;
-	if (data->perm == PERM_PRE_ROOT || data->perm == PERM_ANDROID)
-		return 1;
-	return 0;
-}
-
-static int needs_fixup(perm_t perm)
-{
-	if (perm == PERM_ANDROID_DATA || perm == PERM_ANDROID_OBB
-			|| perm == PERM_ANDROID_MEDIA)
-		return 1;
-	return 0;
-}
-
-static void __fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit, int depth)
-{
-	struct dentry *child;
-	struct sdcardfs_inode_info *info;
-
-	/*
-	 * All paths will terminate their recursion on hitting PERM_ANDROID_OBB,
-	 * PERM_ANDROID_MEDIA, or PERM_ANDROID_DATA. This happens at a depth of
-	 * at most 3.
-	 */
-	WARN(depth > 3, "%s: Max expected depth exceeded!\n", __func__);
-	spin_lock_nested(&dentry->d_lock, depth);
-	if (!d_inode(dentry)) {
-		spin_unlock(&dentry->d_lock);
-		return;
-	}
-	info = SDCARDFS_I(d_inode(dentry));
-
-	if (needs_fixup(info->data->perm)) {
-		list_for_each_entry(child, &dentry->d_subdirs, d_child) {
-			spin_lock_nested(&child->d_lock, depth + 1);
-			if (!(limit->flags & BY_NAME) ||
-				qstr_case_eq(&child->d_name, &limit->name)) {
-				if (d_inode(child)) {
-					get_derived_permission(d_inode(dentry),
-									child);
-					fixup_tmp_permissions(d_inode(child));
-					spin_unlock(&child->d_lock);
-					break;
-				}
-			}
-			spin_unlock(&child->d_lock);
-		}
-	} else if (descendant_may_need_fixup(info->data, limit)) {
-		list_for_each_entry(child, &dentry->d_subdirs, d_child) {
-			__fixup_perms_recursive(child, limit, depth + 1);
-		}
-	}
-	spin_unlock(&dentry->d_lock);
-}
-
-void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit)
-{
-	__fixup_perms_recursive(dentry, limit, 0);
-}
-
 /* main function for updating derived permission */
 inline void update_derived_permission_lock(struct inode *dir,
 					struct inode *inode,
@@ -19,6 +19,8 @@
  */
 
 #include <linux/fscrypt.h>
+#include <linux/hash.h>
+#include <linux/vmalloc.h>
 #include "sdcardfs.h"
 #include "linux/delay.h"
 
@@ -228,26 +230,266 @@ int sdcardfs_interpose(struct inode *dir, struct dentry *dentry,
 	return PTR_ERR(ret_dentry);
 }
 
+/*
+ * A lookup that misses in exact case has to scan the whole lower directory
+ * for a case-insensitive match.  The first scan therefore also records every
+ * name by casefolded hash, and later lookups in the directory are answered
+ * from that for as long as the lower directory's ctime and i_version are
+ * unchanged.
+ */
+#define SDCARDFS_NAME_CACHE_MAX	(64 * 1024)
+
+/*
+ * Name caches live until their directory's inode is evicted, so the memory
+ * all of them may use together is bounded too.  A directory whose cache
+ * doesn't fit is simply scanned at every miss, as before.
+ */
+#define SDCARDFS_NAME_CACHE_TOTAL_MAX	(4 * 1024 * 1024)
+
+static atomic_long_t sdcardfs_name_cache_bytes = ATOMIC_LONG_INIT(0);
+
+struct sdcardfs_name_entry {
+	struct hlist_node node;
+	unsigned int hash;
+	unsigned int len;
+	char name[];
+};
+
+struct sdcardfs_name_cache {
+	struct timespec ctime;
+	u64 version;
+	size_t bytes;
+	unsigned int shift;
+	struct hlist_head buckets[];
+};
+
 struct sdcardfs_name_data {
 	struct dir_context ctx;
 	const struct qstr *to_find;
 	char *name;
 	bool found;
+	/* every name seen, while building the cache */
+	bool collect;
+	unsigned int count;
+	size_t bytes;
+	struct hlist_head names;
 };
 
+static size_t sdcardfs_name_entry_size(unsigned int len)
+{
+	return sizeof(struct sdcardfs_name_entry) + len + 1;
+}
+
+static unsigned int sdcardfs_name_hash(const char *name, unsigned int len)
+{
+	unsigned long hash = init_name_hash(NULL);
+
+	while (len--)
+		hash = partial_name_hash(tolower(*name++), hash);
+	return end_name_hash(hash);
+}
+
+static void sdcardfs_free_name_list(struct hlist_head *head)
+{
+	struct sdcardfs_name_entry *entry;
+	struct hlist_node *tmp;
+
+	hlist_for_each_entry_safe(entry, tmp, head, node)
+		kfree(entry);
+	INIT_HLIST_HEAD(head);
+}
+
+void sdcardfs_free_name_cache(struct sdcardfs_inode_info *info)
+{
+	struct sdcardfs_name_cache *cache = info->name_cache;
+	unsigned int i;
+
+	if (!cache)
+		return;
+	for (i = 0; i < 1U << cache->shift; i++)
+		sdcardfs_free_name_list(&cache->buckets[i]);
+	atomic_long_sub(cache->bytes, &sdcardfs_name_cache_bytes);
+	kvfree(cache);
+	info->name_cache = NULL;
+}
+
+static struct sdcardfs_name_entry *sdcardfs_name_cache_find(
+		struct sdcardfs_name_cache *cache, const char *name,
+		unsigned int len, unsigned int hash)
+{
+	struct sdcardfs_name_entry *entry;
+
+	hlist_for_each_entry(entry, &cache->buckets[hash_32(hash, cache->shift)],
+			     node) {
+		if (entry->hash == hash && entry->len == len &&
+		    str_n_case_eq(entry->name, name, len))
+			return entry;
+	}
+	return NULL;
+}
+
+static struct sdcardfs_name_cache *sdcardfs_name_cache_build(
+		struct hlist_head *names, unsigned int count, size_t bytes,
+		const struct timespec *ctime, u64 version)
+{
+	struct sdcardfs_name_cache *cache;
+	struct sdcardfs_name_entry *entry, *old;
+	struct hlist_node *tmp;
+	unsigned int shift;
+	size_t size;
+
+	shift = ilog2(roundup_pow_of_two(max(count / 2, 16U)));
+	size = sizeof(*cache) + (sizeof(struct hlist_head) << shift);
+	bytes += size;
+	if (atomic_long_add_return(bytes, &sdcardfs_name_cache_bytes) >
+			SDCARDFS_NAME_CACHE_TOTAL_MAX)
+		goto uncharge;
+
+	cache = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!cache)
+		cache = vzalloc(size);
+	if (!cache)
+		goto uncharge;
+	cache->ctime = *ctime;
+	cache->version = version;
+	cache->bytes = bytes;
+	cache->shift = shift;
+
+	/*
+	 * @names is in reverse directory order.  A later entry differing
+	 * only in case was seen first by the scan, so it replaces the one
+	 * already hashed, as the scan would have stopped there.
+	 */
+	hlist_for_each_entry_safe(entry, tmp, names, node) {
+		hlist_del(&entry->node);
+		old = sdcardfs_name_cache_find(cache, entry->name, entry->len,
+					       entry->hash);
+		if (old) {
+			size = sdcardfs_name_entry_size(old->len);
+			cache->bytes -= size;
+			atomic_long_sub(size, &sdcardfs_name_cache_bytes);
+			hlist_del(&old->node);
+			kfree(old);
+		}
+		hlist_add_head(&entry->node,
+			       &cache->buckets[hash_32(entry->hash, shift)]);
+	}
+	return cache;
+
+uncharge:
+	atomic_long_sub(bytes, &sdcardfs_name_cache_bytes);
+	sdcardfs_free_name_list(names);
+	return NULL;
+}
+
 static int sdcardfs_name_match(struct dir_context *ctx, const char *name,
 		int namelen, loff_t offset, u64 ino, unsigned int d_type)
 {
 	struct sdcardfs_name_data *buf = container_of(ctx, struct sdcardfs_name_data, ctx);
 	struct qstr candidate = QSTR_INIT(name, namelen);
+	struct sdcardfs_name_entry *entry;
+
+	if (buf->collect) {
+		buf->bytes += sdcardfs_name_entry_size(namelen);
+		entry = kmalloc(sdcardfs_name_entry_size(namelen), GFP_KERNEL);
+		if (!entry || ++buf->count > SDCARDFS_NAME_CACHE_MAX ||
+		    atomic_long_read(&sdcardfs_name_cache_bytes) + buf->bytes >
+				SDCARDFS_NAME_CACHE_TOTAL_MAX) {
+			kfree(entry);
+			sdcardfs_free_name_list(&buf->names);
+			buf->collect = false;
+		} else {
+			entry->hash = sdcardfs_name_hash(name, namelen);
+			entry->len = namelen;
+			memcpy(entry->name, name, namelen);
+			entry->name[namelen] = 0;
+			hlist_add_head(&entry->node, &buf->names);
+		}
+	}
 
-	if (qstr_case_eq(buf->to_find, &candidate)) {
+	if (!buf->found && qstr_case_eq(buf->to_find, &candidate)) {
 		memcpy(buf->name, name, namelen);
 		buf->name[namelen] = 0;
 		buf->found = true;
-		return 1;
 	}
-	return 0;
+	return buf->found && !buf->collect;
+}
+
+/*
+ * Find the lower spelling of @name ignoring case and copy it to @found.
+ * Returns 0, -ENOENT, or an error from opening or reading the directory.
+ */
+static int sdcardfs_find_ci_name(struct inode *dir,
+				 struct path *lower_parent_path,
+				 const struct qstr *name, char *found)
+{
+	struct sdcardfs_inode_info *info = SDCARDFS_I(dir);
+	struct inode *lower_dir = d_inode(lower_parent_path->dentry);
+	struct sdcardfs_name_cache *cache;
+	struct sdcardfs_name_entry *entry;
+	struct timespec ctime, now;
+	struct file *file;
+	u64 version;
+	int err;
+
+	struct sdcardfs_name_data buffer = {
+		.ctx.actor = sdcardfs_name_match,
+		.to_find = name,
+		.name = found,
+		.found = false,
+		.names = HLIST_HEAD_INIT,
+	};
+
+	mutex_lock(&info->name_cache_lock);
+	cache = info->name_cache;
+	if (cache && timespec_equal(&cache->ctime, &lower_dir->i_ctime) &&
+	    cache->version == lower_dir->i_version) {
+		entry = sdcardfs_name_cache_find(cache, name->name, name->len,
+				sdcardfs_name_hash(name->name, name->len));
+		if (entry) {
+			memcpy(found, entry->name, entry->len + 1);
+			err = 0;
+		} else {
+			err = -ENOENT;
+		}
+		goto out;
+	}
+	sdcardfs_free_name_cache(info);
+
+	/*
+	 * Sample the lower directory before reading it, so that a change
+	 * racing with the scan shows up at the next lookup.  Don't cache if
+	 * it changed within the current clock tick, as a further change in
+	 * that tick would not move its ctime, nor for an encrypted directory
+	 * without its key, whose names change once the key is added.
+	 */
+	ctime = lower_dir->i_ctime;
+	version = lower_dir->i_version;
+	now = current_time(lower_dir);
+	buffer.collect = timespec_compare(&ctime, &now) < 0 &&
+			 !(IS_ENCRYPTED(lower_dir) &&
+			   !fscrypt_has_encryption_key(lower_dir));
+
+	file = dentry_open(lower_parent_path, O_RDONLY, current_cred());
+	if (IS_ERR(file)) {
+		err = PTR_ERR(file);
+		goto out_free;
+	}
+	err = iterate_dir(file, &buffer.ctx);
+	fput(file);
+	if (err)
+		goto out_free;
+
+	if (buffer.collect)
+		info->name_cache = sdcardfs_name_cache_build(&buffer.names,
+					buffer.count, buffer.bytes, &ctime,
+					version);
+	err = buffer.found ? 0 : -ENOENT;
+out_free:
+	sdcardfs_free_name_list(&buffer.names);
+out:
+	mutex_unlock(&info->name_cache_lock);
+	return err;
 }
 
 /*
@@ -291,39 +533,20 @@ static struct dentry *__sdcardfs_lookup(struct inode *dir,
 				&lower_path);
 	/* check for other cases */
 	if (err == -ENOENT) {
-		struct file *file;
-		const struct cred *cred = current_cred();
-
-		struct sdcardfs_name_data buffer = {
-			.ctx.actor = sdcardfs_name_match,
-			.to_find = name,
-			.name = __getname(),
-			.found = false,
-		};
+		char *found = __getname();
 
-		if (!buffer.name) {
+		if (!found) {
 			err = -ENOMEM;
 			goto out;
 		}
-		file = dentry_open(lower_parent_path, O_RDONLY, cred);
-		if (IS_ERR(file)) {
-			err = PTR_ERR(file);
-			goto put_name;
-		}
-		err = iterate_dir(file, &buffer.ctx);
-		fput(file);
-		if (err)
-			goto put_name;
-
-		if (buffer.found)
+		err = sdcardfs_find_ci_name(dir, lower_parent_path, name,
+					    found);
+		if (!err)
 			err = vfs_path_lookup(lower_dir_dentry,
 						lower_dir_mnt,
-						buffer.name, 0,
+						found, 0,
 						&lower_path);
-		else
-			err = -ENOENT;
-put_name:
-		__putname(buffer.name);
+		__putname(found);
 	}
 
 	/* no error: handle positive dentries */
@@ -151,6 +151,7 @@ extern struct inode *sdcardfs_iget(struct super_block *sb,
 extern int sdcardfs_interpose(struct inode *dir, struct dentry *dentry,
 				struct super_block *sb,
 				struct path *lower_path, userid_t id);
+extern void sdcardfs_free_name_cache(struct sdcardfs_inode_info *info);
 
 /* file private data */
 struct sdcardfs_file_info {
@@ -168,6 +169,16 @@ struct sdcardfs_inode_data {
 	bool under_android;
 	bool under_cache;
 	bool under_obb;
+
+	/* PERM_ANDROID_PACKAGE only, to re-derive d_uid lazily */
+	unsigned int pkg_gen;
+	uid_t pkg_base_uid;
+	struct sdcardfs_pkg_name *pkg_name;
+};
+
+struct sdcardfs_pkg_name {
+	struct rcu_head rcu;
+	char name[];
 };
 
 /* sdcardfs inode data in memory */
@@ -181,6 +192,10 @@ struct sdcardfs_inode_info {
 	spinlock_t top_alias_lock;
 	struct sdcardfs_inode_data *top_data;
 
+	/* casefolded names of the lower directory, see lookup.c */
+	struct mutex name_cache_lock;
+	struct sdcardfs_name_cache *name_cache;
+
 	struct inode vfs_inode;
 };
 
@@ -349,6 +364,8 @@ static inline bool sbinfo_has_sdcard_magic(struct sdcardfs_sb_info *sbinfo)
 			&& sbinfo->sb->s_magic == SDCARDFS_SUPER_MAGIC;
 }
 
+extern bool refresh_package_data(struct sdcardfs_inode_data *data);
+
 static inline struct sdcardfs_inode_data *data_get(
 		struct sdcardfs_inode_data *data)
 {
@@ -365,6 +382,8 @@ static inline struct sdcardfs_inode_data *top_data_get(
 	spin_lock(&info->top_lock);
 	top_data = data_get(info->top_data);
 	spin_unlock(&info->top_lock);
+	if (top_data)
+		refresh_package_data(top_data);
 	return top_data;
 }
 
@@ -492,25 +511,17 @@ extern struct list_head sdcardfs_super_list;
 extern appid_t get_appid(const char *app_name);
 extern appid_t get_ext_gid(const char *app_name);
 extern appid_t is_excluded(const char *app_name, userid_t userid);
+extern unsigned int get_packagelist_gen(void);
 extern int check_caller_access_to_name(struct inode *parent_node, const struct qstr *name);
 extern int packagelist_init(void);
 extern void packagelist_exit(void);
 
 /* for derived_perm.c */
-#define BY_NAME		(1 << 0)
-#define BY_USERID	(1 << 1)
-struct limit_search {
-	unsigned int flags;
-	struct qstr name;
-	userid_t userid;
-};
-
 extern void setup_derived_state(struct inode *inode, perm_t perm,
 			userid_t userid, uid_t uid);
 extern void get_derived_permission(struct inode *parent, struct dentry *dentry);
 extern void get_derived_permission_new(struct inode *parent,
 			struct inode *inode, const struct qstr *name);
-extern void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit);
 
 extern void update_derived_permission_lock(struct inode *dir,
 			struct inode *inode, struct dentry *dentry);
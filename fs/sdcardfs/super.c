@@ -40,6 +40,7 @@ void data_release(struct kref *ref)
 	struct sdcardfs_inode_data *data =
 		container_of(ref, struct sdcardfs_inode_data, refcount);
 
+	kfree(data->pkg_name);
 	kmem_cache_free(sdcardfs_inode_data_cachep, data);
 }
 
@@ -184,6 +185,7 @@ static void sdcardfs_evict_inode(struct inode *inode)
 
 	truncate_inode_pages(&inode->i_data, 0);
 	set_top(SDCARDFS_I(inode), NULL);
+	sdcardfs_free_name_cache(SDCARDFS_I(inode));
 	clear_inode(inode);
 	/*
 	 * Decrement a reference to a lower_inode, which was incremented
@@ -218,6 +220,7 @@ static struct inode *sdcardfs_alloc_inode(struct super_block *sb)
 	i->top_data = d;
 	spin_lock_init(&i->top_lock);
 	spin_lock_init(&i->top_alias_lock);
+	mutex_init(&i->name_cache_lock);
 	kref_get(&d->refcount);
 
 	i->vfs_inode.i_version = 1;
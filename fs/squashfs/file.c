@@ -47,6 +47,8 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -374,6 +376,46 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 	return squashfs_block_size(size);
 }
 
+
+/*
+ * Like read_blocklist(), for the @n consecutive datablocks starting at
+ * @index: the meta index is walked once and all the sizes are read in one
+ * go.  @size is scratch space for @n entries.
+ */
+static int read_blocklist_range(struct inode *inode, int index, int n,
+	__le32 *size, u64 *block, int *bsize)
+{
+	u64 start;
+	long long blks;
+	int offset, i;
+	int res = fill_meta_index(inode, index, &start, &offset, block);
+
+	if (res < 0)
+		return res;
+
+	if (res < index) {
+		blks = read_indexes(inode->i_sb, index - res, &start, &offset);
+		if (blks < 0)
+			return (int) blks;
+		*block += blks;
+	}
+
+	res = squashfs_read_metadata(inode->i_sb, size, &start, &offset,
+			n * sizeof(*size));
+	if (res < 0)
+		return res;
+
+	for (i = 0; i < n; i++) {
+		bsize[i] = squashfs_block_size(size[i]);
+		if (bsize[i] < 0)
+			return bsize[i];
+		if (i)
+			block[i] = block[i - 1] +
+				SQUASHFS_COMPRESSED_SIZE_BLOCK(bsize[i - 1]);
+	}
+	return 0;
+}
+
 void squashfs_fill_page(struct page *page, struct squashfs_cache_entry *buffer, int offset, int avail)
 {
 	int copied;
@@ -457,7 +499,27 @@ static int squashfs_readpage_sparse(struct page *page, int expected)
 	return 0;
 }
 
-static int squashfs_readpage(struct file *file, struct page *page)
+/* Is the page inside the file and its data in a datablock of its own? */
+static bool squashfs_page_in_blocklist(struct inode *inode, pgoff_t index)
+{
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+
+	if (index >= ((i_size_read(inode) + PAGE_SIZE - 1) >> PAGE_SHIFT))
+		return false;
+
+	return (index >> (msblk->block_log - PAGE_SHIFT)) < file_end ||
+		squashfs_i(inode)->fragment_block == SQUASHFS_INVALID_BLK;
+}
+
+/*
+ * Fill a locked page, and what can be had of the rest of its datablock,
+ * then unlock it.  @block and @bsize are the datablock's location as
+ * returned by read_blocklist(), ignored unless
+ * squashfs_page_in_blocklist().
+ */
+static void squashfs_fill_locked_page(struct page *page, u64 block,
+	int bsize)
 {
 	struct inode *inode = page->mapping->host;
 	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
@@ -469,17 +531,11 @@ static int squashfs_readpage(struct file *file, struct page *page)
 	int res;
 	void *pageaddr;
 
-	TRACE("Entered squashfs_readpage, page index %lx, start block %llx\n",
-				page->index, squashfs_i(inode)->start);
-
 	if (page->index >= ((i_size_read(inode) + PAGE_SIZE - 1) >>
 					PAGE_SHIFT))
 		goto out;
 
-	if (index < file_end || squashfs_i(inode)->fragment_block ==
-					SQUASHFS_INVALID_BLK) {
-		u64 block = 0;
-		int bsize = read_blocklist(inode, index, &block);
+	if (squashfs_page_in_blocklist(inode, page->index)) {
 		if (bsize < 0)
 			goto error_out;
 
@@ -491,7 +547,7 @@ static int squashfs_readpage(struct file *file, struct page *page)
 		res = squashfs_readpage_fragment(page, expected);
 
 	if (!res)
-		return 0;
+		return;
 
 error_out:
 	SetPageError(page);
@@ -503,11 +559,164 @@ static int squashfs_readpage(struct file *file, struct page *page)
 	if (!PageError(page))
 		SetPageUptodate(page);
 	unlock_page(page);
+}
+
+static int squashfs_readpage(struct file *file, struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+	u64 block = 0;
+	int bsize = 0;
 
+	TRACE("Entered squashfs_readpage, page index %lx, start block %llx\n",
+				page->index, squashfs_i(inode)->start);
+
+	if (squashfs_page_in_blocklist(inode, page->index)) {
+		struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+
+		bsize = read_blocklist(inode,
+			page->index >> (msblk->block_log - PAGE_SHIFT), &block);
+	}
+
+	squashfs_fill_locked_page(page, block, bsize);
+	return 0;
+}
+
+
+/* Most datablocks a single readahead call decompresses concurrently */
+#define SQUASHFS_READPAGES_MAX	16
+
+struct workqueue_struct *squashfs_read_wq;
+
+struct squashfs_readpages_work {
+	struct work_struct	work;
+	struct page		*page;
+	u64			block;
+	int			bsize;
+	atomic_t		*pending;
+	struct completion	*done;
+};
+
+static void squashfs_readpages_worker(struct work_struct *work)
+{
+	struct squashfs_readpages_work *rw = container_of(work,
+		struct squashfs_readpages_work, work);
+
+	squashfs_fill_locked_page(rw->page, rw->block, rw->bsize);
+	if (atomic_dec_and_test(rw->pending))
+		complete(rw->done);
+}
+
+/*
+ * Readahead: one page of each datablock in the window is added to the
+ * page cache and filled like squashfs_readpage() would, which brings in
+ * the rest of the block too.  The locations of all the blocks are looked
+ * up together, and with more than one decompressor the blocks are read
+ * and decompressed in parallel on squashfs_read_wq.  Pages not
+ * used are freed by the caller, which is fine as their blocks have
+ * already been pulled in.
+ */
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_SHIFT;
+	struct squashfs_readpages_work *rw;
+	struct page *page, *next;
+	DECLARE_COMPLETION_ONSTACK(done);
+	atomic_t pending;
+	__le32 *size;
+	u64 *block;
+	int *bsize;
+	int first, n, nlist, i, queued, head;
+
+	/* The list runs from the highest index down to the lowest */
+	page = list_entry(pages->prev, struct page, lru);
+	first = page->index >> shift;
+	n = (list_first_entry(pages, struct page, lru)->index >> shift) -
+		first + 1;
+	n = min(n, SQUASHFS_READPAGES_MAX);
+
+	rw = kcalloc(n, sizeof(*rw) + sizeof(*size) + sizeof(*block) +
+		sizeof(*bsize), GFP_KERNEL);
+	if (rw == NULL)
+		return 0;
+	block = (u64 *) (rw + n);
+	size = (__le32 *) (block + n);
+	bsize = (int *) (size + n);
+
+	/* Blocks in the window that have an entry in the block list */
+	for (nlist = 0; nlist < n; nlist++)
+		if (!squashfs_page_in_blocklist(inode,
+				(pgoff_t) (first + nlist) << shift))
+			break;
+
+	if (nlist && read_blocklist_range(inode, first, nlist, size, block,
+			bsize) < 0)
+		goto out;
+
+	list_for_each_entry_safe_reverse(page, next, pages, lru) {
+		i = (page->index >> shift) - first;
+		if (i >= n || rw[i].page)
+			continue;
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index,
+				readahead_gfp_mask(mapping))) {
+			put_page(page);
+			continue;
+		}
+		rw[i].page = page;
+		rw[i].block = block[i];
+		rw[i].bsize = bsize[i];
+	}
+
+	for (queued = 0, head = -1, i = 0; i < n; i++) {
+		if (rw[i].page == NULL)
+			continue;
+
+		rw[i].pending = &pending;
+		rw[i].done = &done;
+		if (head < 0)
+			head = i;
+		queued++;
+	}
+	atomic_set(&pending, queued);
+
+	/*
+	 * The first block is done here, the others by the workqueue.  Queue
+	 * them before starting on the first, so they run alongside it.  With
+	 * a single decompressor everything is done here, in order.
+	 */
+	if (queued && squashfs_max_decompressors() > 1) {
+		for (i = head + 1; i < n; i++) {
+			if (rw[i].page == NULL)
+				continue;
+
+			INIT_WORK(&rw[i].work, squashfs_readpages_worker);
+			queue_work(squashfs_read_wq, &rw[i].work);
+		}
+		squashfs_readpages_worker(&rw[head].work);
+	} else if (queued) {
+		for (i = head; i < n; i++)
+			if (rw[i].page)
+				squashfs_readpages_worker(&rw[i].work);
+	}
+
+	if (queued)
+		wait_for_completion(&done);
+
+	for (i = 0; i < n; i++)
+		if (rw[i].page)
+			put_page(rw[i].page);
+
+out:
+	kfree(rw);
 	return 0;
 }
 
 
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
@@ -70,6 +70,7 @@ extern __le64 *squashfs_read_fragment_index_table(struct super_block *,
 void squashfs_fill_page(struct page *, struct squashfs_cache_entry *, int, int);
 void squashfs_copy_cache(struct page *, struct squashfs_cache_entry *, int,
 				int);
+extern struct workqueue_struct *squashfs_read_wq;
 
 /* file_xxx.c */
 extern int squashfs_readpage_block(struct page *, u64, int, int);
@@ -38,6 +38,7 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/workqueue.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -445,8 +446,17 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	/* Readahead decompresses on here, in parallel */
+	squashfs_read_wq = alloc_workqueue("squashfs_read",
+				WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!squashfs_read_wq) {
+		destroy_inodecache();
+		return -ENOMEM;
+	}
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		destroy_workqueue(squashfs_read_wq);
 		destroy_inodecache();
 		return err;
 	}
@@ -460,6 +470,7 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	destroy_workqueue(squashfs_read_wq);
 	destroy_inodecache();
 }
 
@@ -1,10 +1,23 @@
+#ifndef __LZ4ACCEL_H__
+#define __LZ4ACCEL_H__
+
 #include <linux/types.h>
 #include <asm/simd.h>
 
+/*
+ * Callers run the accelerated decoder on the bulk of a block and finish
+ * with their own C decoder, keeping this far from the end of both the
+ * source and destination buffers.
+ */
+#define LZ4_ACCEL_MARGIN	128
+
 #if defined(CONFIG_ARM64) && defined(CONFIG_KERNEL_MODE_NEON)
 #include <asm/neon.h>
 #include <asm/cputype.h>
 
+typedef int (*lz4_decompress_asm_t)(uint8_t **dst_ptr, uint8_t *dst_begin,
+	uint8_t *dst_end, const uint8_t **src_ptr, const uint8_t *src_end);
+
 int _lz4_decompress_asm(uint8_t **dst_ptr, uint8_t *dst_begin,
 			uint8_t *dst_end, const uint8_t **src_ptr,
 			const uint8_t *src_end);
@@ -18,9 +31,16 @@ static inline int lz4_decompress_accel_enable(void)
 	return	may_use_simd();
 }
 
-extern int (*lz4_decompress_asm_fn[])(uint8_t **dst_ptr, uint8_t *dst_begin,
-	uint8_t *dst_end, const uint8_t **src_ptr,
-	const uint8_t *src_end);
+extern lz4_decompress_asm_t lz4_decompress_asm_fn[];
+
+/*
+ * Calibration stream shared with the throughput benchmark in lib/lz4,
+ * NULL until it has been built at boot.
+ */
+const uint8_t *lz4_accel_sample(size_t *src_len, size_t *dst_len);
+
+/* Variant picked for the calling cpu's core type, never NULL */
+lz4_decompress_asm_t lz4_decompress_asm_current(void);
 
 static inline ssize_t lz4_decompress_asm(
 	uint8_t **dst_ptr, uint8_t *dst_begin, uint8_t *dst_end,
@@ -52,3 +72,5 @@ static inline ssize_t lz4_decompress_asm(
 	return 0;
 }
 #endif
+
+#endif /* __LZ4ACCEL_H__ */
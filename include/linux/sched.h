@@ -1240,6 +1240,8 @@ struct eas_stats {
 	u64 secb_no_nrg_sav;
 	u64 secb_nrg_sav;
 	u64 secb_count;
+	u64 secb_time;		/* ns spent placing tasks */
+	u64 secb_ls_fast;
 
 	/* find_best_target() stats */
 	u64 fbt_attempts;
@@ -1258,8 +1260,16 @@ struct sched_domain_shared {
 	atomic_t	ref;
 	atomic_t	nr_busy_cpus;
 	int		has_idle_cores;
+
+	/* CPUs of the LLC running their idle task, see update_idle_cpus() */
+	unsigned long	idle_cpus[0];
 };
 
+static inline struct cpumask *sds_idle_cpus(struct sched_domain_shared *sds)
+{
+	return to_cpumask(sds->idle_cpus);
+}
+
 struct sched_domain {
 	/* These fields must be setup */
 	struct sched_domain *parent;	/* top domain must be null terminated */
@@ -1539,6 +1549,7 @@ struct sched_statistics {
 	u64			nr_wakeups_secb_no_nrg_sav;
 	u64			nr_wakeups_secb_nrg_sav;
 	u64			nr_wakeups_secb_count;
+	u64			nr_wakeups_secb_ls_fast;
 
 	/* find_best_target() */
 	u64			nr_wakeups_fbt_attempts;
@@ -2849,6 +2860,8 @@ extern int sched_set_group_id(struct task_struct *p, unsigned int group_id);
 extern unsigned int sched_get_group_id(struct task_struct *p);
 extern int sched_set_init_task_load(struct task_struct *p, int init_load_pct);
 extern u32 sched_get_init_task_load(struct task_struct *p);
+extern void sched_get_task_demand(struct task_struct *p, u32 *demand,
+				  u32 *pred_demand);
 extern void sched_update_cpu_freq_min_max(const cpumask_t *cpus, u32 fmin,
 					  u32 fmax);
 extern int sched_set_boost(int enable);
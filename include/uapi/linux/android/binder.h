@@ -173,6 +173,14 @@ struct binder_fd_object {
  * in the offset array pointing to the parent binder_buffer_object,
  * and by setting @parent_offset to the offset in the parent buffer
  * at which the pointer to this buffer is located.
+ *
+ * If @buffer lies in a donation ring (a shared mapping of the binder
+ * fd at BINDER_DONATE_RING_OFFSET) and BINDER_BUFFER_FLAG_DONATE is
+ * set, whole pages of the buffer may be moved to the target instead
+ * of copied. Moved pages read back as zeroes in the sender. To move
+ * pages the kernel has to match the page offset of @buffer in the
+ * target, so the sender should reserve PAGE_SIZE of extra buffer space
+ * for each donated buffer; without room the buffer is just copied.
  */
 struct binder_buffer_object {
 	struct binder_object_header	hdr;
@@ -185,8 +193,12 @@ struct binder_buffer_object {
 
 enum {
 	BINDER_BUFFER_FLAG_HAS_PARENT = 0x01,
+	BINDER_BUFFER_FLAG_DONATE = 0x02,
 };
 
+/* mmap offset of the per-process page donation ring */
+#define BINDER_DONATE_RING_OFFSET	0x40000000
+
 /* struct binder_fd_array_object - object describing an array of fds in a buffer
  * @hdr:		common header structure
  * @pad:		padding to ensure correct alignment
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Mapped WRITE payloads for FUSE daemons
+ *
+ * A daemon may mmap() its /dev/fuse fd read-only and shared, at offset 0,
+ * with a length that is a multiple of FUSE_RING_SLOT_PAGES pages.  WRITE
+ * requests whose data was mapped into that area instead of being copied
+ * carry FUSE_WRITE_MAPPED in fuse_write_in.write_flags, and a struct
+ * fuse_mapped_in in place of the data.  The data must not be accessed
+ * after the request has been replied to.
+ */
+
+#ifndef _UAPI_LINUX_FUSE_RING_H
+#define _UAPI_LINUX_FUSE_RING_H
+
+#include <linux/types.h>
+
+/* Pages per slot of the mapping, one slot per request in flight */
+#define FUSE_RING_SLOT_PAGES	32
+
+/* fuse_write_in.write_flags: the data was mapped, see fuse_mapped_in */
+#define FUSE_WRITE_MAPPED	(1U << 31)
+
+/**
+ * struct fuse_mapped_in - location of the data of a mapped WRITE
+ * @offset: offset of the first byte of data from the start of the mapping
+ */
+struct fuse_mapped_in {
+	__u64	offset;
+};
+
+#endif /* _UAPI_LINUX_FUSE_RING_H */
@@ -1013,6 +1013,7 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 		P_SCHEDSTAT(se.statistics.nr_wakeups_secb_no_nrg_sav);
 		P_SCHEDSTAT(se.statistics.nr_wakeups_secb_nrg_sav);
 		P_SCHEDSTAT(se.statistics.nr_wakeups_secb_count);
+		P_SCHEDSTAT(se.statistics.nr_wakeups_secb_ls_fast);
 		/* find_best_target() */
 		P_SCHEDSTAT(se.statistics.nr_wakeups_fbt_attempts);
 		P_SCHEDSTAT(se.statistics.nr_wakeups_fbt_no_cpu);
@@ -5749,24 +5749,72 @@ static unsigned long __cpu_norm_util(unsigned long util, unsigned long capacity)
 	return (util << SCHED_CAPACITY_SHIFT)/capacity;
 }
 
-static unsigned long group_max_util(struct energy_env *eenv, int cpu_idx)
+/*
+ * Utilization of an SG without the task, gathered once per SG by
+ * calc_sg_energy() so that each CPU candidate only costs the delta of
+ * placing the task on it.
+ */
+struct sg_energy_base {
+	/* cpu_util_wake() of each CPU candidate within sg or sg_cap */
+	unsigned long	cpu_util[EAS_CPU_CNT];
+
+	/* Max util in sg_cap, including any capacity_min_of() capping */
+	unsigned long	max_util;
+
+	/* Shallowest idle state in sg, accounting for active idle */
+	int		idle_state;
+
+	/* Sum of util in sg, valid once grp_util_valid is set */
+	long		grp_util;
+	bool		grp_util_valid;
+
+	/* Sum of normalized util in sg, per OPP seen so far */
+	int		nr_norm;
+	struct {
+		int		cap_idx;
+		unsigned long	util_sum;
+	} norm[EAS_CPU_CNT];
+};
+
+/*
+ * Return the utilization of @cpu without the task, reusing the value
+ * sampled in sg_energy_base_init() if @cpu is a candidate so that all the
+ * sums built on top of it stay consistent with each other.
+ */
+static unsigned long
+sg_cpu_util(struct energy_env *eenv, struct sg_energy_base *base, int cpu)
 {
-	unsigned long max_util = 0;
+	int cpu_idx;
+
+	if (cpumask_test_cpu(cpu, &eenv->cpus_mask)) {
+		for (cpu_idx = EAS_CPU_PRV; cpu_idx < EAS_CPU_CNT; ++cpu_idx) {
+			if (eenv->cpu[cpu_idx].cpu_id == cpu)
+				return base->cpu_util[cpu_idx];
+		}
+	}
+
+	return cpu_util_wake(cpu, eenv->p);
+}
+
+static int sg_energy_base_init(struct energy_env *eenv,
+			       struct sg_energy_base *base)
+{
+	int cpu, cpu_idx, state = INT_MAX;
 	unsigned long util;
-	int cpu;
+
+	base->max_util = 0;
+	base->grp_util_valid = false;
+	base->nr_norm = 0;
 
 	for_each_cpu(cpu, sched_group_cpus(eenv->sg_cap)) {
 		util = cpu_util_wake(cpu, eenv->p);
 
-		/*
-		 * If we are looking at the target CPU specified by the eenv,
-		 * then we should add the (estimated) utilization of the task
-		 * assuming we will wake it up on that CPU.
-		 */
-		if (unlikely(cpu == eenv->cpu[cpu_idx].cpu_id))
-			util += eenv->util_delta;
+		for (cpu_idx = EAS_CPU_PRV; cpu_idx < EAS_CPU_CNT; ++cpu_idx) {
+			if (eenv->cpu[cpu_idx].cpu_id == cpu)
+				base->cpu_util[cpu_idx] = util;
+		}
 
-		max_util = max(max_util, util);
+		base->max_util = max(base->max_util, util);
 
 		/*
 		 * Take into account any minimum frequency imposed
@@ -5774,10 +5822,47 @@ static unsigned long group_max_util(struct energy_env *eenv, int cpu_idx)
 		 * If the MIN_CAPACITY_CAPPING feature is not enabled
 		 * capacity_min_of will return 0 (not capped).
 		 */
-		max_util = max(max_util, capacity_min_of(cpu));
+		base->max_util = max(base->max_util, capacity_min_of(cpu));
+	}
 
+	/* sg_cap isn't necessarily a superset of sg */
+	for (cpu_idx = EAS_CPU_PRV; cpu_idx < EAS_CPU_CNT; ++cpu_idx) {
+		cpu = eenv->cpu[cpu_idx].cpu_id;
+		if (cpu == -1)
+			continue;
+		if (cpumask_test_cpu(cpu, sched_group_cpus(eenv->sg)) &&
+		    !cpumask_test_cpu(cpu, sched_group_cpus(eenv->sg_cap)))
+			base->cpu_util[cpu_idx] = cpu_util_wake(cpu, eenv->p);
 	}
 
+	/* Find the shallowest idle state in the sched group. */
+	for_each_cpu(cpu, sched_group_cpus(eenv->sg))
+		state = min(state, idle_get_state_idx(cpu_rq(cpu)));
+
+	if (unlikely(state == INT_MAX))
+		return -EINVAL;
+
+	/* Take non-cpuidle idling into account (active idle/arch_cpu_idle()) */
+	base->idle_state = state + 1;
+
+	return 0;
+}
+
+static unsigned long group_max_util(struct energy_env *eenv,
+				    struct sg_energy_base *base, int cpu_idx)
+{
+	unsigned long max_util = base->max_util;
+
+	/*
+	 * If the target CPU specified by the eenv is in the group, then we
+	 * should add the (estimated) utilization of the task assuming we
+	 * will wake it up on that CPU.
+	 */
+	if (cpumask_test_cpu(eenv->cpu[cpu_idx].cpu_id,
+			     sched_group_cpus(eenv->sg_cap)))
+		max_util = max(max_util,
+			       base->cpu_util[cpu_idx] + eenv->util_delta);
+
 	return max_util;
 }
 
@@ -5791,36 +5876,54 @@ static unsigned long group_max_util(struct energy_env *eenv, int cpu_idx)
  * when iterating over all CPUs in the group.
  * The latter estimate is used as it leads to a more pessimistic energy
  * estimate (more busy).
+ *
+ * The sum without the task only depends on the capacity, so it's computed
+ * once per OPP and the target CPU's term is swapped for its util with the
+ * task.
  */
 static unsigned
-long group_norm_util(struct energy_env *eenv, int cpu_idx)
+long group_norm_util(struct energy_env *eenv, struct sg_energy_base *base,
+		     int cpu_idx)
 {
 	unsigned long capacity = eenv->cpu[cpu_idx].cap;
-	unsigned long util, util_sum = 0;
-	int cpu;
+	int cap_idx = eenv->cpu[cpu_idx].cap_idx;
+	unsigned long util, util_sum;
+	int i, cpu;
 
-	for_each_cpu(cpu, sched_group_cpus(eenv->sg)) {
-		util = cpu_util_wake(cpu, eenv->p);
+	for (i = 0; i < base->nr_norm; i++) {
+		if (base->norm[i].cap_idx == cap_idx)
+			break;
+	}
 
-		/*
-		 * If we are looking at the target CPU specified by the eenv,
-		 * then we should add the (estimated) utilization of the task
-		 * assuming we will wake it up on that CPU.
-		 */
-		if (unlikely(cpu == eenv->cpu[cpu_idx].cpu_id))
-			util += eenv->util_delta;
+	if (i == base->nr_norm) {
+		util_sum = 0;
+		for_each_cpu(cpu, sched_group_cpus(eenv->sg))
+			util_sum += __cpu_norm_util(sg_cpu_util(eenv, base, cpu),
+						    capacity);
 
-		util_sum += __cpu_norm_util(util, capacity);
+		base->norm[i].cap_idx = cap_idx;
+		base->norm[i].util_sum = util_sum;
+		base->nr_norm++;
+	}
+
+	util_sum = base->norm[i].util_sum;
+
+	if (cpumask_test_cpu(eenv->cpu[cpu_idx].cpu_id,
+			     sched_group_cpus(eenv->sg))) {
+		util = base->cpu_util[cpu_idx];
+		util_sum -= __cpu_norm_util(util, capacity);
+		util_sum += __cpu_norm_util(util + eenv->util_delta, capacity);
 	}
 
 	return min_t(unsigned long, util_sum, SCHED_CAPACITY_SCALE);
 }
 
-static int find_new_capacity(struct energy_env *eenv, int cpu_idx)
+static int find_new_capacity(struct energy_env *eenv,
+			     struct sg_energy_base *base, int cpu_idx)
 {
 	const struct sched_group_energy *sge = eenv->sg->sge;
 	int idx, max_idx = sge->nr_cap_states - 1;
-	unsigned long util = group_max_util(eenv, cpu_idx);
+	unsigned long util = group_max_util(eenv, base, cpu_idx);
 
 	/* default is max_cap if we don't find a match */
 	eenv->cpu[cpu_idx].cap_idx = max_idx;
@@ -5838,22 +5941,13 @@ static int find_new_capacity(struct energy_env *eenv, int cpu_idx)
 	return eenv->cpu[cpu_idx].cap_idx;
 }
 
-static int group_idle_state(struct energy_env *eenv, int cpu_idx)
+static int group_idle_state(struct energy_env *eenv,
+			    struct sg_energy_base *base, int cpu_idx)
 {
 	struct sched_group *sg = eenv->sg;
-	int i, state = INT_MAX;
+	int i, state = base->idle_state;
 	int src_in_grp, dst_in_grp;
-	long grp_util = 0;
-
-	/* Find the shallowest idle state in the sched group. */
-	for_each_cpu(i, sched_group_cpus(sg))
-		state = min(state, idle_get_state_idx(cpu_rq(i)));
-
-	if (unlikely(state == INT_MAX))
-		return -EINVAL;
-
-	/* Take non-cpuidle idling into account (active idle/arch_cpu_idle()) */
-	state++;
+	long grp_util;
 
 	src_in_grp = cpumask_test_cpu(eenv->cpu[EAS_CPU_PRV].cpu_id,
 				      sched_group_cpus(sg));
@@ -5870,12 +5964,17 @@ static int group_idle_state(struct energy_env *eenv, int cpu_idx)
 	 * Try to estimate if a deeper idle state is
 	 * achievable when we move the task.
 	 */
-	for_each_cpu(i, sched_group_cpus(sg)) {
-		grp_util += cpu_util_wake(i, eenv->p);
-		if (unlikely(i == eenv->cpu[cpu_idx].cpu_id))
-			grp_util += eenv->util_delta;
+	if (!base->grp_util_valid) {
+		base->grp_util = 0;
+		for_each_cpu(i, sched_group_cpus(sg))
+			base->grp_util += sg_cpu_util(eenv, base, i);
+		base->grp_util_valid = true;
 	}
 
+	grp_util = base->grp_util;
+	if (dst_in_grp)
+		grp_util += eenv->util_delta;
+
 	if (grp_util <=
 		((long)sg->sgc->max_capacity * (int)sg->group_weight)) {
 		/* after moving, this group is at most partly
@@ -5911,7 +6010,9 @@ static int group_idle_state(struct energy_env *eenv, int cpu_idx)
  * calc_sg_energy: compute energy for the eenv's SG (i.e. eenv->sg).
  *
  * This works in iterations to compute the SG's energy for each CPU
- * candidate defined by the energy_env's cpu array.
+ * candidate defined by the energy_env's cpu array. The SG is scanned once
+ * up front (see struct sg_energy_base) and each iteration then only
+ * accounts for the task being placed on its candidate.
  *
  * NOTE: in the following computations for busy_energy and idle_energy we do
  * not shift by SCHED_CAPACITY_SHIFT in order to reduce rounding errors.
@@ -5927,26 +6028,30 @@ static int calc_sg_energy(struct energy_env *eenv)
 	unsigned long sg_util;
 	int cap_idx, idle_idx;
 	int total_energy = 0;
+	struct sg_energy_base base;
 	int cpu_idx;
 
+	if (sg_energy_base_init(eenv, &base))
+		return -EINVAL;
+
 	for (cpu_idx = EAS_CPU_PRV; cpu_idx < EAS_CPU_CNT; ++cpu_idx) {
 
 
 		if (eenv->cpu[cpu_idx].cpu_id == -1)
 			continue;
 		/* Compute ACTIVE energy */
-		cap_idx = find_new_capacity(eenv, cpu_idx);
+		cap_idx = find_new_capacity(eenv, &base, cpu_idx);
 		busy_power = sg->sge->cap_states[cap_idx].power;
 		/*
 		 * in order to calculate cpu_norm_util, we need to know which
 		 * capacity level the group will be at, so calculate that first
 		 */
-		sg_util = group_norm_util(eenv, cpu_idx);
+		sg_util = group_norm_util(eenv, &base, cpu_idx);
 
 		busy_energy   = sg_util * busy_power;
 
 		/* Compute IDLE energy */
-		idle_idx = group_idle_state(eenv, cpu_idx);
+		idle_idx = group_idle_state(eenv, &base, cpu_idx);
 		if (unlikely(idle_idx < 0))
 			return idle_idx;
 		if (idle_idx > sg->sge->nr_idle_states - 1)
@@ -6670,6 +6775,36 @@ static inline int find_idlest_cpu(struct sched_domain *sd, struct task_struct *p
 	return new_cpu;
 }
 
+/*
+ * Keep sd_llc_shared->idle_cpus in sync with the CPUs running their idle
+ * task, so that wakeup placement can find idle CPUs with one read per
+ * cluster instead of probing every rq. Called with the rq lock held on
+ * idle entry and exit.
+ */
+void update_idle_cpus(struct rq *rq, bool idle)
+{
+	struct sched_domain_shared *sds;
+	struct cpumask *idle_cpus;
+	int cpu = cpu_of(rq);
+
+	rcu_read_lock();
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (!sds)
+		goto unlock;
+
+	/* Don't dirty the shared cacheline if nothing changes */
+	idle_cpus = sds_idle_cpus(sds);
+	if (cpumask_test_cpu(cpu, idle_cpus) == idle)
+		goto unlock;
+
+	if (idle)
+		cpumask_set_cpu(cpu, idle_cpus);
+	else
+		cpumask_clear_cpu(cpu, idle_cpus);
+unlock:
+	rcu_read_unlock();
+}
+
 #ifdef CONFIG_SCHED_SMT
 
 static inline void set_idle_cores(int cpu, int val)
@@ -7056,6 +7191,67 @@ static int start_cpu(struct task_struct *p, bool boosted,
 	return walt_start_cpu(start_cpu);
 }
 
+/*
+ * Return true if @cpu is idle and @p, needing at least @min_util, fits there
+ * with the same margin find_best_target() applies.
+ */
+static bool idle_cpu_fits(struct task_struct *p, int cpu,
+			  unsigned long min_util)
+{
+	unsigned long new_util;
+
+	if (!cpu_online(cpu) || cpu_isolated(cpu))
+		return false;
+
+	if (walt_cpu_high_irqload(cpu) || is_reserved(cpu))
+		return false;
+
+	if (capacity_of(cpu) < min_util)
+		return false;
+
+	new_util = max(min_util, cpu_util_wake(cpu, p) + task_util(p));
+	if (cpu_check_overutil_condition(cpu, new_util))
+		return false;
+
+	return idle_cpu(cpu);
+}
+
+/*
+ * Return the first CPU of @search_cpus, in the order find_best_target()
+ * visits them starting from @start, which is idle and where @p fits, or -1.
+ *
+ * Only the CPUs the LLC summary reports idle are probed. The summary can
+ * be stale in either direction: a CPU marked idle is checked again here,
+ * and an idle CPU not marked yet is still found by the full scan.
+ */
+static int find_idle_fit_cpu(struct task_struct *p, struct sched_group *sg,
+			     struct cpumask *search_cpus, int start,
+			     bool avoid_prev_cpu)
+{
+	unsigned long min_util = boosted_task_util(p);
+	struct sched_domain_shared *sds;
+	cpumask_t idle_cpus;
+	int i;
+
+	sds = rcu_dereference(per_cpu(sd_llc_shared,
+				      cpumask_first(sched_group_cpus(sg))));
+	if (!sds)
+		return -1;
+
+	if (!cpumask_and(&idle_cpus, search_cpus, sds_idle_cpus(sds)))
+		return -1;
+
+	for_each_cpu_wrap(i, &idle_cpus, start) {
+		if (avoid_prev_cpu && i == task_cpu(p))
+			continue;
+
+		if (idle_cpu_fits(p, i, min_util))
+			return i;
+	}
+
+	return -1;
+}
+
 unsigned int sched_smp_overlap_capacity;
 static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 				   bool boosted, bool prefer_idle,
@@ -7115,6 +7311,27 @@ static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 		if (do_rotate)
 			fbt_env->avoid_prev_cpu = avoid_prev_cpu;
 
+		/*
+		 * Case A.1 (see below) only cares about the first idle CPU,
+		 * look for it among the CPUs known to be idle before probing
+		 * the busy ones.
+		 */
+		if (prefer_idle) {
+			int idle_fit_cpu = find_idle_fit_cpu(p, sg, &search_cpus,
+							     i + 1, avoid_prev_cpu);
+
+			if (idle_fit_cpu != -1) {
+				schedstat_inc(p->se.statistics.nr_wakeups_fbt_pref_idle);
+				schedstat_inc(this_rq()->eas_stats.fbt_pref_idle);
+
+				trace_sched_find_best_target(p, prefer_idle,
+						min_util, cpu, best_idle_cpu,
+						best_active_cpu, idle_fit_cpu, -1);
+
+				return idle_fit_cpu;
+			}
+		}
+
 retry:
 		while ((i = cpumask_next(i, &search_cpus)) < nr_cpu_ids) {
 			unsigned long capacity_curr = capacity_curr_of(i);
@@ -7577,11 +7794,95 @@ enum fastpaths {
 	NONE = 0,
 	SYNC_WAKEUP,
 	PREV_CPU_BIAS,
+	LATENCY_SENSITIVE,
 };
 
+/*
+ * Deepest cpuidle state index a latency sensitive task is woken up in by
+ * find_latency_sensitive_cpu(). State 0 is WFI on the platforms we ship.
+ */
+#define LS_FASTPATH_MAX_IDLE_IDX	0
+
+/*
+ * Wakeup fast path for latency sensitive tasks: pick an idle CPU in a
+ * shallow idle state where the task fits with the same margin
+ * find_best_target() applies, without going through find_best_target()
+ * and the energy evaluation.
+ *
+ * Only the CPUs the LLC summary reports idle are probed. Like start_cpu(),
+ * boosted tasks prefer the biggest capacity and the others the smallest;
+ * within that capacity prev_cpu is taken if it qualifies, otherwise the
+ * shallowest idle state. Returns -1 if no CPU qualifies.
+ */
+static int find_latency_sensitive_cpu(struct task_struct *p, int prev_cpu,
+				      bool boosted)
+{
+	unsigned long min_util = boosted_task_util(p);
+	unsigned long best_capacity = boosted ? 0 : ULONG_MAX;
+	int best_idle_idx = INT_MAX;
+	int best_cpu = -1;
+	struct sched_domain *sd;
+	struct sched_group *sg;
+
+	sd = rcu_dereference(per_cpu(sd_ea, prev_cpu));
+	if (!sd)
+		return -1;
+
+	sg = sd->groups;
+	do {
+		struct sched_domain_shared *sds;
+		cpumask_t search_cpus;
+		int i;
+
+		/* Skip clusters the task doesn't fit in */
+		if (sg->sgc->max_capacity < min_util)
+			continue;
+
+		sds = rcu_dereference(per_cpu(sd_llc_shared,
+					      cpumask_first(sched_group_cpus(sg))));
+		if (!sds)
+			continue;
+
+		cpumask_and(&search_cpus, sched_group_cpus(sg),
+			    sds_idle_cpus(sds));
+		if (!cpumask_and(&search_cpus, &search_cpus,
+				 tsk_cpus_allowed(p)))
+			continue;
+
+		for_each_cpu(i, &search_cpus) {
+			unsigned long capacity_orig = capacity_orig_of(i);
+			int idle_idx;
+
+			if (!idle_cpu_fits(p, i, min_util))
+				continue;
+
+			idle_idx = idle_get_state_idx(cpu_rq(i));
+			if (idle_idx > LS_FASTPATH_MAX_IDLE_IDX)
+				continue;
+
+			if (boosted ? capacity_orig < best_capacity :
+				      capacity_orig > best_capacity)
+				continue;
+
+			if (capacity_orig == best_capacity) {
+				if (best_cpu == prev_cpu)
+					continue;
+				if (i != prev_cpu && idle_idx >= best_idle_idx)
+					continue;
+			}
+
+			best_capacity = capacity_orig;
+			best_idle_idx = idle_idx;
+			best_cpu = i;
+		}
+	} while (sg = sg->next, sg != sd->groups);
+
+	return best_cpu;
+}
+
 static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync)
 {
-	bool boosted, prefer_idle;
+	bool boosted, prefer_idle, latency_sensitive;
 	struct sched_domain *sd;
 	int target_cpu;
 	int backup_cpu = -1;
@@ -7591,7 +7892,7 @@ static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync
 	u64 start_t = 0;
 	int fastpath = 0;
 
-	if (trace_sched_task_util_enabled())
+	if (trace_sched_task_util_enabled() || schedstat_enabled())
 		start_t = sched_clock();
 
 	schedstat_inc(p->se.statistics.nr_wakeups_secb_attempts);
@@ -7608,6 +7909,9 @@ static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync
 	prefer_idle = 0;
 #endif
 
+	/* EAS_USE_NEED_IDLE may turn prefer_idle into need_idle below */
+	latency_sensitive = prefer_idle;
+
 	fbt_env.rtg_target = rtg_target;
 	if (sched_feat(EAS_USE_NEED_IDLE) && prefer_idle) {
 		fbt_env.need_idle = true;
@@ -7648,6 +7952,24 @@ static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync
 
 	sync_entity_load_avg(&p->se);
 
+	/*
+	 * Latency sensitive tasks go straight to a shallow idle CPU they fit
+	 * in, unless a related thread group or placement boost dictates where
+	 * they should run. Tasks which only need_idle because of their waker
+	 * take the regular path.
+	 */
+	if (latency_sensitive && !rtg_target &&
+	    fbt_env.placement_boost == SCHED_BOOST_NONE) {
+		next_cpu = find_latency_sensitive_cpu(p, prev_cpu, boosted);
+		if (next_cpu != -1) {
+			schedstat_inc(p->se.statistics.nr_wakeups_secb_ls_fast);
+			schedstat_inc(this_rq()->eas_stats.secb_ls_fast);
+			target_cpu = next_cpu;
+			fastpath = LATENCY_SENSITIVE;
+			goto out;
+		}
+	}
+
 	/* Find a cpu with sufficient capacity */
 	next_cpu = find_best_target(p, &backup_cpu, boosted, prefer_idle,
 				    &fbt_env);
@@ -7724,6 +8046,10 @@ static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync
 	schedstat_inc(this_rq()->eas_stats.secb_count);
 
 out:
+	if (start_t)
+		schedstat_add(this_rq()->eas_stats.secb_time,
+			      sched_clock() - start_t);
+
 	trace_sched_task_util(p, next_cpu, backup_cpu, target_cpu, sync,
 			      fbt_env.need_idle, fastpath,
 			      fbt_env.placement_boost, rtg_target ?
@@ -11946,6 +12272,8 @@ static void walt_fixup_sched_stats_fair(struct rq *rq, struct task_struct *p,
 	s64 task_load_delta = (s64)new_task_load - task_load(p);
 	s64 pred_demand_delta = PRED_DEMAND_DELTA;
 
+	schedtune_fixup_demand(p, cpu_of(rq), new_task_load, new_pred_demand);
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 
@@ -12018,6 +12346,7 @@ static int task_will_be_throttled(struct task_struct *p)
 static void walt_fixup_sched_stats_fair(struct rq *rq, struct task_struct *p,
 				       u32 new_task_load, u32 new_pred_demand)
 {
+	schedtune_fixup_demand(p, cpu_of(rq), new_task_load, new_pred_demand);
 	fixup_walt_sched_stats_common(rq, p, new_task_load, new_pred_demand);
 }
 
@@ -28,6 +28,7 @@ pick_next_task_idle(struct rq *rq, struct task_struct *prev, struct rq_flags *rf
 {
 	put_prev_task(rq, prev);
 	update_idle_core(rq);
+	update_idle_cpus(rq, true);
 	schedstat_inc(rq->sched_goidle);
 	return rq->idle;
 }
@@ -47,6 +48,7 @@ dequeue_task_idle(struct rq *rq, struct task_struct *p, int flags)
 
 static void put_prev_task_idle(struct rq *rq, struct task_struct *prev)
 {
+	update_idle_cpus(rq, false);
 	rq_last_tick_reset(rq);
 }
 
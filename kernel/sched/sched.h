@@ -60,6 +60,16 @@ struct load_subtractions {
 	u64 new_subs;
 };
 
+/*
+ * A cpu's view of its last closed window.  Written under the cpu's rq
+ * lock when it rolls over, read locklessly when aggregating a cluster.
+ */
+struct walt_window_snap {
+	seqcount_t seq;
+	u64 window_start;
+	u64 grp_prev_runnable_sum;
+};
+
 #define NUM_TRACKED_WINDOWS 2
 #define NUM_LOAD_INDICES 1000
 
@@ -121,6 +131,12 @@ extern void update_idle_core(struct rq *rq);
 static inline void update_idle_core(struct rq *rq) { }
 #endif
 
+#ifdef CONFIG_SMP
+extern void update_idle_cpus(struct rq *rq, bool idle);
+#else
+static inline void update_idle_cpus(struct rq *rq, bool idle) { }
+#endif
+
 /*
  * Helpers for converting nanosecond timing to jiffy resolution
  */
@@ -900,6 +916,8 @@ struct rq {
 	int prev_top;
 	int curr_top;
 	bool notif_pending;
+	bool load_subs_pending;
+	struct walt_window_snap window_snap;
 	u64 last_cc_update;
 	u64 cycles;
 #endif
@@ -326,6 +326,11 @@ struct boost_groups {
 		int boost;
 		/* Count of RUNNABLE tasks on that boost group */
 		unsigned tasks;
+#ifdef CONFIG_SCHED_WALT
+		/* WALT demand and predicted demand of those tasks */
+		u64 demand;
+		u64 pred_demand;
+#endif
 	} group[BOOSTGROUPS_COUNT];
 	/* CPU's boost group locking */
 	raw_spinlock_t lock;
@@ -483,6 +488,39 @@ schedtune_boostgroup_update(int idx, int boost)
 #define ENQUEUE_TASK  1
 #define DEQUEUE_TASK -1
 
+#ifdef CONFIG_SCHED_WALT
+/*
+ * The per boost group counterpart of the rq's cumulative_runnable_avg and
+ * pred_demands_sum: added and removed along with the tasks count, and
+ * fixed up by schedtune_fixup_demand() while a task stays RUNNABLE.
+ * Must be called after the tasks count has been updated.
+ */
+static inline void
+schedtune_demand_update(struct boost_groups *bg, int idx,
+			struct task_struct *p, int task_count)
+{
+	s64 demand, pred_demand;
+
+	/* Don't let rounding or missed updates linger past the last task */
+	if (!bg->group[idx].tasks) {
+		bg->group[idx].demand = 0;
+		bg->group[idx].pred_demand = 0;
+		return;
+	}
+
+	demand = bg->group[idx].demand + task_count * (s64)p->ravg.demand;
+	pred_demand = bg->group[idx].pred_demand +
+		      task_count * (s64)p->ravg.pred_demand;
+
+	bg->group[idx].demand = max_t(s64, 0, demand);
+	bg->group[idx].pred_demand = max_t(s64, 0, pred_demand);
+}
+#else
+static inline void
+schedtune_demand_update(struct boost_groups *bg, int idx,
+			struct task_struct *p, int task_count) { }
+#endif
+
 static inline void
 schedtune_tasks_update(struct task_struct *p, int cpu, int idx, int task_count)
 {
@@ -491,6 +529,7 @@ schedtune_tasks_update(struct task_struct *p, int cpu, int idx, int task_count)
 
 	/* Update boosted tasks count while avoiding to make it negative */
 	bg->group[idx].tasks = max(0, tasks);
+	schedtune_demand_update(bg, idx, p, task_count);
 
 	trace_sched_tune_tasks_update(p, cpu, tasks, idx,
 			bg->group[idx].boost, bg->boost_max);
@@ -599,6 +638,8 @@ int schedtune_can_attach(struct cgroup_taskset *tset)
 		tasks = bg->group[src_bg].tasks - 1;
 		bg->group[src_bg].tasks = max(0, tasks);
 		bg->group[dst_bg].tasks += 1;
+		schedtune_demand_update(bg, src_bg, task, DEQUEUE_TASK);
+		schedtune_demand_update(bg, dst_bg, task, ENQUEUE_TASK);
 
 		raw_spin_unlock(&bg->lock);
 		unlock_rq_of(rq, task, &irq_flags);
@@ -670,6 +711,61 @@ bool schedtune_task_colocated(struct task_struct *p)
 	return colocated;
 }
 
+/*
+ * NOTE: This function must be called while holding the lock on the CPU RQ,
+ * before the RUNNABLE task's demand is set to the new values
+ */
+void schedtune_fixup_demand(struct task_struct *p, int cpu,
+			    u32 new_task_load, u32 new_pred_demand)
+{
+	struct boost_groups *bg = &per_cpu(cpu_boost_groups, cpu);
+	unsigned long irq_flags;
+	s64 demand, pred_demand;
+	int idx;
+
+	if (!unlikely(schedtune_initialized))
+		return;
+
+	/* Exiting tasks are not accounted, see schedtune_dequeue_task() */
+	if (p->flags & PF_EXITING)
+		return;
+
+	raw_spin_lock_irqsave(&bg->lock, irq_flags);
+	rcu_read_lock();
+
+	idx = task_schedtune(p)->idx;
+	demand = bg->group[idx].demand +
+		 ((s64)new_task_load - p->ravg.demand);
+	pred_demand = bg->group[idx].pred_demand +
+		      ((s64)new_pred_demand - p->ravg.pred_demand);
+	bg->group[idx].demand = max_t(s64, 0, demand);
+	bg->group[idx].pred_demand = max_t(s64, 0, pred_demand);
+
+	rcu_read_unlock();
+	raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
+}
+
+/*
+ * Aggregated WALT demand of the group's RUNNABLE tasks, in ns of busy
+ * time per window, summed over all CPUs.  Cheap enough to be polled.
+ */
+static int sched_demand_show(struct seq_file *sf, void *v)
+{
+	struct schedtune *st = css_st(seq_css(sf));
+	u64 demand = 0, pred_demand = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct boost_groups *bg = &per_cpu(cpu_boost_groups, cpu);
+
+		demand += READ_ONCE(bg->group[st->idx].demand);
+		pred_demand += READ_ONCE(bg->group[st->idx].pred_demand);
+	}
+
+	seq_printf(sf, "demand %llu\npred_demand %llu\n", demand, pred_demand);
+	return 0;
+}
+
 #else /* CONFIG_SCHED_WALT */
 
 static inline void init_sched_boost(struct schedtune *st) { }
@@ -893,6 +989,10 @@ static struct cftype files[] = {
 		.read_u64 = sched_colocate_read,
 		.write_u64 = sched_colocate_write,
 	},
+	{
+		.name = "demand",
+		.seq_show = sched_demand_show,
+	},
 #endif
 	{
 		.name = "boost",
@@ -918,6 +1018,10 @@ schedtune_boostgroup_init(struct schedtune *st, int idx)
 		bg = &per_cpu(cpu_boost_groups, cpu);
 		bg->group[idx].boost = 0;
 		bg->group[idx].valid = true;
+#ifdef CONFIG_SCHED_WALT
+		bg->group[idx].demand = 0;
+		bg->group[idx].pred_demand = 0;
+#endif
 	}
 
 	/* Keep track of allocated boost groups */
@@ -24,6 +24,13 @@ void schedtune_exit_task(struct task_struct *tsk);
 void schedtune_enqueue_task(struct task_struct *p, int cpu);
 void schedtune_dequeue_task(struct task_struct *p, int cpu);
 
+#ifdef CONFIG_SCHED_WALT
+void schedtune_fixup_demand(struct task_struct *p, int cpu,
+			    u32 new_task_load, u32 new_pred_demand);
+#else
+#define schedtune_fixup_demand(task, cpu, load, pred) do { } while (0)
+#endif
+
 #else /* CONFIG_CGROUP_SCHEDTUNE */
 
 #define schedtune_cpu_boost(cpu)  get_sysctl_sched_cfs_boost()
@@ -34,6 +41,7 @@ void schedtune_dequeue_task(struct task_struct *p, int cpu);
 
 #define schedtune_enqueue_task(task, cpu) do { } while (0)
 #define schedtune_dequeue_task(task, cpu) do { } while (0)
+#define schedtune_fixup_demand(task, cpu, load, pred) do { } while (0)
 
 #endif /* CONFIG_CGROUP_SCHEDTUNE */
 
@@ -51,6 +59,7 @@ int schedtune_accept_deltas(int nrg_delta, int cap_delta,
 
 #define schedtune_enqueue_task(task, cpu) do { } while (0)
 #define schedtune_dequeue_task(task, cpu) do { } while (0)
+#define schedtune_fixup_demand(task, cpu, load, pred) do { } while (0)
 
 #define schedtune_accept_deltas(nrg_delta, cap_delta, task) nrg_delta
 
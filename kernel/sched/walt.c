@@ -52,6 +52,8 @@ u64 walt_load_reported_window;
 
 static struct irq_work walt_cpufreq_irq_work;
 static struct irq_work walt_migration_irq_work;
+/* serializes the rollover and migration irq works against each other */
+static DEFINE_RAW_SPINLOCK(walt_irq_work_lock);
 
 void
 walt_fixup_cumulative_runnable_avg(struct rq *rq,
@@ -688,6 +690,8 @@ void update_cluster_load_subtractions(struct task_struct *p,
 				p->ravg.prev_window_cpu[i], new_task);
 			p->ravg.prev_window_cpu[i] = 0;
 		}
+
+		rq->load_subs_pending = true;
 	}
 
 	raw_spin_unlock(&cluster->load_lock);
@@ -1961,6 +1965,42 @@ update_task_rq_cpu_cycles(struct task_struct *p, struct rq *rq, int event,
 	trace_sched_get_task_cpu_cycles(cpu, event, rq->cc.cycles, rq->cc.time, p);
 }
 
+/*
+ * Apply the load other cpus moved out of this one and publish the cpu's
+ * last window for walt_irq_work().  Called with rq->lock held once the
+ * current task has rolled the cpu's window over.
+ */
+static void walt_close_window(struct rq *rq)
+{
+	struct sched_cluster *cluster = rq->cluster;
+	struct walt_window_snap *snap = &rq->window_snap;
+
+	raw_spin_lock(&cluster->load_lock);
+	account_load_subtractions(rq);
+	rq->load_subs_pending = false;
+	raw_spin_unlock(&cluster->load_lock);
+
+	write_seqcount_begin(&snap->seq);
+	snap->window_start = rq->window_start;
+	snap->grp_prev_runnable_sum = rq->grp_time.prev_runnable_sum;
+	write_seqcount_end(&snap->seq);
+}
+
+static u64 walt_read_window_snap(struct rq *rq, u64 *grp_prev_runnable_sum)
+{
+	struct walt_window_snap *snap = &rq->window_snap;
+	unsigned int seq;
+	u64 ws;
+
+	do {
+		seq = read_seqcount_begin(&snap->seq);
+		ws = snap->window_start;
+		*grp_prev_runnable_sum = snap->grp_prev_runnable_sum;
+	} while (read_seqcount_retry(&snap->seq, seq));
+
+	return ws;
+}
+
 static inline void run_walt_irq_work(u64 old_window_start, struct rq *rq)
 {
 	u64 result;
@@ -1998,6 +2038,10 @@ void update_task_ravg(struct task_struct *p, struct rq *rq, int event,
 	update_cpu_busy_time(p, rq, event, wallclock, irqtime);
 	update_task_pred_demand(rq, p, event);
 
+	/* the current task has just rolled the cpu's window over */
+	if (p == rq->curr && rq->window_snap.window_start != rq->window_start)
+		walt_close_window(rq);
+
 	if (exiting_task(p))
 		goto done;
 
@@ -2017,6 +2061,13 @@ u32 sched_get_init_task_load(struct task_struct *p)
 	return p->init_load_pct;
 }
 
+void sched_get_task_demand(struct task_struct *p, u32 *demand,
+			   u32 *pred_demand)
+{
+	*demand = READ_ONCE(p->ravg.demand);
+	*pred_demand = READ_ONCE(p->ravg.pred_demand);
+}
+
 int sched_set_init_task_load(struct task_struct *p, int init_load_pct)
 {
 	if (init_load_pct < 0 || init_load_pct > 100)
@@ -3244,52 +3295,57 @@ int sched_little_cluster_coloc_fmin_khz_handler(struct ctl_table *table,
 /*
  * Runs in hard-irq context. This should ideally run just after the latest
  * window roll-over.
+ *
+ * Busy cpus close their window themselves, from update_task_ravg().  Only
+ * the cpus which haven't, or which were handed load subtractions since,
+ * are closed from here, and every rq lock is taken on its own so no cpu
+ * waits for more than its own update.
  */
 void walt_irq_work(struct irq_work *irq_work)
 {
 	struct sched_cluster *cluster;
 	struct rq *rq;
 	int cpu;
-	u64 wc, total_grp_load = 0;
+	u64 wc, ws, grp_prev, total_grp_load = 0;
 	int flag = SCHED_CPUFREQ_WALT;
 	bool is_migration = false;
-	int level = 0;
 
 	/* Am I the window rollover work or the migration work? */
 	if (irq_work == &walt_migration_irq_work)
 		is_migration = true;
 
-	for_each_cpu(cpu, cpu_possible_mask) {
-		if (level == 0)
-			raw_spin_lock(&cpu_rq(cpu)->lock);
-		else
-			raw_spin_lock_nested(&cpu_rq(cpu)->lock, level);
-		level++;
-	}
+	raw_spin_lock(&walt_irq_work_lock);
 
 	wc = sched_ktime_clock();
 	walt_load_reported_window = atomic64_read(&walt_irq_work_lastq_ws);
 
+	for_each_cpu(cpu, cpu_possible_mask) {
+		rq = cpu_rq(cpu);
+
+		ws = walt_read_window_snap(rq, &grp_prev);
+		if (ws >= walt_load_reported_window &&
+				!READ_ONCE(rq->load_subs_pending))
+			continue;
+
+		raw_spin_lock(&rq->lock);
+		if (rq->curr) {
+			update_task_ravg(rq->curr, rq, TASK_UPDATE, wc, 0);
+			walt_close_window(rq);
+		}
+		raw_spin_unlock(&rq->lock);
+	}
+
 	for_each_sched_cluster(cluster) {
 		u64 aggr_grp_load = 0;
 
-		raw_spin_lock(&cluster->load_lock);
-
 		for_each_cpu(cpu, &cluster->cpus) {
-			rq = cpu_rq(cpu);
-			if (rq->curr) {
-				update_task_ravg(rq->curr, rq,
-						TASK_UPDATE, wc, 0);
-				account_load_subtractions(rq);
-				aggr_grp_load += rq->grp_time.prev_runnable_sum;
-			}
+			walt_read_window_snap(cpu_rq(cpu), &grp_prev);
+			aggr_grp_load += grp_prev;
 		}
 
 		cluster->aggr_grp_load = aggr_grp_load;
 		total_grp_load = aggr_grp_load;
 		cluster->coloc_boost_load = 0;
-
-		raw_spin_unlock(&cluster->load_lock);
 	}
 
 	if (total_grp_load)
@@ -3301,6 +3357,7 @@ void walt_irq_work(struct irq_work *irq_work)
 
 			rq = cpu_rq(cpu);
 
+			raw_spin_lock(&rq->lock);
 			if (is_migration) {
 				if (rq->notif_pending) {
 					nflag |= SCHED_CPUFREQ_INTERCLUSTER_MIG;
@@ -3311,11 +3368,11 @@ void walt_irq_work(struct irq_work *irq_work)
 			}
 
 			cpufreq_update_util(rq, nflag);
+			raw_spin_unlock(&rq->lock);
 		}
 	}
 
-	for_each_cpu(cpu, cpu_possible_mask)
-		raw_spin_unlock(&cpu_rq(cpu)->lock);
+	raw_spin_unlock(&walt_irq_work_lock);
 
 	if (!is_migration)
 		core_ctl_check(this_rq()->window_start);
@@ -3416,6 +3473,10 @@ void walt_sched_init(struct rq *rq)
 	}
 	rq->cum_window_demand = 0;
 	rq->notif_pending = false;
+	rq->load_subs_pending = false;
+	seqcount_init(&rq->window_snap.seq);
+	rq->window_snap.window_start = 0;
+	rq->window_snap.grp_prev_runnable_sum = 0;
 
 	walt_cpu_util_freq_divisor =
 	    (sched_ravg_window >> SCHED_CAPACITY_SHIFT) * 100;
@@ -40,6 +40,11 @@
 #ifndef STATIC
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/debugfs.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/lz4accel.h>
 #endif
 #include <linux/lz4.h>
 
@@ -47,6 +52,11 @@
 
 #include "lz4defs.h"
 
+/* The boot-time decompressors (STATIC) stay plain C */
+#if defined(__ARCH_HAS_LZ4_ACCELERATOR) && !defined(STATIC)
+#define LZ4_ACCEL
+#endif
+
 static const int dec32table[] = {0, 3, 2, 3, 0, 0, 0, 0};
 #if LZ4_ARCH64
 static const int dec64table[] = {0, 0, 0, -1, 0, 1, 2, 3};
@@ -170,16 +180,17 @@ static int lz4_uncompress(const char *source, char *dest, int osize)
 	return -1;
 }
 
-static int lz4_uncompress_unknownoutputsize(const char *source, char *dest,
+/*
+ * Decode from @ip/@op on, which the accelerated decoder may already have
+ * moved past the start of the buffers.
+ */
+static int __lz4_uncompress_unknownoutputsize(const BYTE *ip, BYTE *op,
+				const char *source, char *dest,
 				int isize, size_t maxoutputsize)
 {
-	const BYTE *ip = (const BYTE *) source;
-	const BYTE *const iend = ip + isize;
+	const BYTE *const iend = (const BYTE *) source + isize;
 	const BYTE *ref;
-
-
-	BYTE *op = (BYTE *) dest;
-	BYTE * const oend = op + maxoutputsize;
+	BYTE * const oend = (BYTE *) dest + maxoutputsize;
 	BYTE *cpy;
 
 	/* Main Loop */
@@ -300,6 +311,28 @@ static int lz4_uncompress_unknownoutputsize(const char *source, char *dest,
 	return -1;
 }
 
+static int lz4_uncompress_unknownoutputsize(const char *source, char *dest,
+				int isize, size_t maxoutputsize)
+{
+	const BYTE *ip = (const BYTE *) source;
+	BYTE *op = (BYTE *) dest;
+
+#ifdef LZ4_ACCEL
+	/* Go fast if we can, keeping away from the end of buffers */
+	if (isize > LZ4_ACCEL_MARGIN && maxoutputsize > LZ4_ACCEL_MARGIN &&
+	    lz4_decompress_accel_enable()) {
+		if (lz4_decompress_asm(&op, (BYTE *) dest,
+				       (BYTE *) dest + maxoutputsize -
+				       LZ4_ACCEL_MARGIN, &ip,
+				       (const BYTE *) source + isize -
+				       LZ4_ACCEL_MARGIN))
+			return -1;
+	}
+#endif
+	return __lz4_uncompress_unknownoutputsize(ip, op, source, dest,
+						  isize, maxoutputsize);
+}
+
 int lz4_decompress(const unsigned char *src, size_t *src_len,
 		unsigned char *dest, size_t actual_dest_len)
 {
@@ -338,6 +371,124 @@ int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
 #ifndef STATIC
 EXPORT_SYMBOL(lz4_decompress_unknownoutputsize);
 
+#ifdef LZ4_ACCEL
+/*
+ * Reading lz4_decompress_bench in debugfs decodes the arch calibration
+ * stream on the current cpu with the C decoder and with each NEON variant
+ * (finishing in C, as above) and reports the best of LZ4_BENCH_LOOPS.
+ * The variant in use on this cpu is starred.
+ */
+#define LZ4_BENCH_LOOPS	16
+
+static const struct {
+	const char *name;
+	lz4_decompress_asm_t fn;
+} lz4_bench_variants[] = {
+	{ "generic",	NULL },
+	{ "prfm",	_lz4_decompress_asm },
+	{ "noprfm",	_lz4_decompress_asm_noprfm },
+};
+
+static struct dentry *lz4_bench_dentry;
+
+/* Returns the best time in ns, or 0 if decoding failed */
+static u64 lz4_bench_one(const BYTE *src, size_t srclen, BYTE *dst,
+			 size_t dstlen, lz4_decompress_asm_t fn)
+{
+	u64 t, best = U64_MAX;
+	int i, ret;
+
+	for (i = 0; i < LZ4_BENCH_LOOPS; i++) {
+		const BYTE *ip = src;
+		BYTE *op = dst;
+
+		kernel_neon_begin();
+		t = local_clock();
+		ret = fn ? fn(&op, dst, dst + dstlen - LZ4_ACCEL_MARGIN,
+			      &ip, src + srclen - LZ4_ACCEL_MARGIN) : 0;
+		if (!ret)
+			ret = __lz4_uncompress_unknownoutputsize(ip, op,
+					(const char *) src, (char *) dst,
+					srclen, dstlen);
+		t = local_clock() - t;
+		kernel_neon_end();
+
+		if (ret != (int)dstlen)
+			return 0;
+		best = min(best, t);
+	}
+	return best;
+}
+
+static int lz4_bench_show(struct seq_file *m, void *v)
+{
+	u64 ns[ARRAY_SIZE(lz4_bench_variants)];
+	lz4_decompress_asm_t cur;
+	size_t srclen, dstlen;
+	const BYTE *src;
+	BYTE *dst;
+	int cpu, i;
+
+	src = lz4_accel_sample(&srclen, &dstlen);
+	if (!src)
+		return -ENODEV;
+	dst = vmalloc(dstlen);
+	if (!dst)
+		return -ENOMEM;
+
+	cpu = get_cpu();
+	kernel_neon_begin();
+	cur = lz4_decompress_asm_current();
+	kernel_neon_end();
+	for (i = 0; i < ARRAY_SIZE(lz4_bench_variants); i++)
+		ns[i] = lz4_bench_one(src, srclen, dst, dstlen,
+				      lz4_bench_variants[i].fn);
+	put_cpu();
+
+	seq_printf(m, "cpu %d part %03x, %zu -> %zu bytes\n", cpu,
+		   read_cpuid_part_number(), srclen, dstlen);
+	for (i = 0; i < ARRAY_SIZE(lz4_bench_variants); i++) {
+		seq_printf(m, "%-8s", lz4_bench_variants[i].name);
+		if (ns[i])
+			seq_printf(m, " %6llu MB/s", div64_u64((u64)dstlen *
+				   NSEC_PER_SEC, ns[i]) >> 20);
+		else
+			seq_puts(m, " failed");
+		seq_puts(m, lz4_bench_variants[i].fn == cur ? " *\n" : "\n");
+	}
+
+	vfree(dst);
+	return 0;
+}
+
+static int lz4_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lz4_bench_show, NULL);
+}
+
+static const struct file_operations lz4_bench_fops = {
+	.open		= lz4_bench_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init lz4_decompress_init(void)
+{
+	lz4_bench_dentry = debugfs_create_file("lz4_decompress_bench", 0400,
+					       NULL, NULL, &lz4_bench_fops);
+	return 0;
+}
+
+static void __exit lz4_decompress_exit(void)
+{
+	debugfs_remove(lz4_bench_dentry);
+}
+
+module_init(lz4_decompress_init);
+module_exit(lz4_decompress_exit);
+#endif
+
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("LZ4 Decompressor");
 #endif